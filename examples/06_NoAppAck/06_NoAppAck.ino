@@ -37,7 +37,7 @@ void onSendResult(const uint8_t *mac, EspNowBus::SendStatus status)
     Serial.println("DroppedFull (queue full)");
     break;
   case EspNowBus::DroppedOldest:
-    Serial.println("DroppedOldest (not used in current implementation)");
+    Serial.println("DroppedOldest (replaced by a newer coalesced send)");
     break;
   case EspNowBus::TooLarge:
     Serial.println("TooLarge (len > maxPayloadBytes)");
@@ -51,6 +51,15 @@ void onSendResult(const uint8_t *mac, EspNowBus::SendStatus status)
   case EspNowBus::AppAckTimeout:
     Serial.println("AppAckTimeout (no logical ACK after retries)");
     break;
+  case EspNowBus::Expired:
+    Serial.println("Expired (ttlMs passed before send/retry)");
+    break;
+  case EspNowBus::PeerUnavailable:
+    Serial.println("PeerUnavailable (peer circuit open)");
+    break;
+  case EspNowBus::RateLimited:
+    Serial.println("RateLimited (airtime budget spent)");
+    break;
   }
 }
 
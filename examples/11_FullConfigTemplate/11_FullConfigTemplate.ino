@@ -27,25 +27,51 @@ void setup()
   cfg.useEncryption = true;      // en: enable ESP-NOW encryption / ja: ESP-NOW 暗号化を有効
   cfg.enablePeerAuth = true;     // en: authenticate peers on join / ja: JOIN 時に peer を認証
   cfg.enableAppAck = true;       // en: app-level ACK on unicast / ja: ユニキャストで AppAck を利用
+  cfg.aggregateUnicast = false;  // en: pack queued small unicasts into one frame / ja: 小さなユニキャストを 1 フレームにまとめる
 
   // en: Radio settings
   // ja: 無線関連の設定
   cfg.channel = -1;                  // en: -1 auto → 1-13 from group hash / ja: -1 自動（ハッシュで 1〜13 を決定）
   cfg.phyRate = WIFI_PHY_RATE_11M_L; // en: 11M long-range default / ja: 11M(L) が既定
+  cfg.broadcastJitterMs = 0;         // en: random extra gap after broadcasts / ja: ブロードキャスト後の乱数待ち
+  cfg.broadcastHistory = 0;          // en: broadcasts kept for NACK repair (0 = off) / ja: NACK 再送用に保持するブロードキャスト数（0 = 無効）
+  cfg.nackDelayMs = 20;              // en: wait before NACKing a broadcast gap / ja: ブロードキャストの欠番を NACK するまでの待ち
+  cfg.fecBlockSize = 0;              // en: broadcasts per XOR parity frame (0 = off) / ja: XOR パリティ 1 フレームあたりのブロードキャスト数（0 = 無効）
+  cfg.airtimeBudgetMsPerSec = 0;     // en: airtime ms/s for all destinations (0 = unlimited) / ja: 全体の空中時間 ms/秒（0 = 無制限）
+  cfg.peerAirtimeBudgetMsPerSec = 0; // en: airtime ms/s per destination (0 = unlimited) / ja: 宛先ごとの空中時間 ms/秒（0 = 無制限）
 
   // en: Queue / payload / timeouts
   // ja: キュー / ペイロード / タイムアウト設定
   cfg.maxQueueLength = 16;                              // en: TX queue depth / ja: 送信キュー長
+  cfg.smallBufferCount = 8;                             // en: extra 64-byte buffers / ja: 追加の 64 バイトバッファ数
+  cfg.mediumBufferCount = 0;                            // en: extra 256-byte buffers / ja: 追加の 256 バイトバッファ数
+  cfg.maxQueuePerPeer = 0;                              // en: per-destination cap (0 = maxQueueLength) / ja: 宛先ごとの上限（0 = maxQueueLength）
   cfg.maxPayloadBytes = EspNowBus::kMaxPayloadDefault;  // en: max payload bytes (1470) / ja: 最大ペイロード 1470 バイト
   cfg.sendTimeoutMs = 50;                               // en: enqueue wait before fail / ja: キュー投入待ちタイムアウト
   cfg.maxRetries = 1;                                   // en: resend count for AppAck / ja: AppAck 用の再送回数
   cfg.retryDelayMs = 0;                                 // en: delay between retries / ja: 再送間隔
+  cfg.retryDelayMaxMs = 1000;                           // en: retry backoff ceiling / ja: 再送バックオフの上限
   cfg.txTimeoutMs = 120;                                // en: physical TX timeout / ja: 物理送信タイムアウト
+  cfg.rtoMinMs = 5;                                     // en: min adaptive AppAck timeout / ja: 適応 AppAck タイムアウトの下限
+  cfg.rtoMaxMs = 2000;                                  // en: max adaptive AppAck timeout / ja: 適応 AppAck タイムアウトの上限
+  cfg.sendWindow = 1;                                   // en: unicast frames awaiting AppAck per peer / ja: peer ごとの AppAck 待ち件数
+  cfg.appAckDelayMs = 0;                                // en: hold AppAck to piggyback on reply data / ja: 返信データに相乗りさせる AppAck 保留時間
+  cfg.maxMessageBytes = 16384;                          // en: largest sendLarge() message / ja: sendLarge() の最大メッセージ長
+  cfg.reassemblySlots = 0;                              // en: receive buffers for sendLarge() (0 = off) / ja: sendLarge() 受信用バッファ数（0 = 無効）
+  cfg.reassemblyTimeoutMs = 5000;                       // en: drop an idle partial message after this / ja: 進まない途中メッセージを破棄するまでの時間
+  cfg.bulkWindow = 0;                                   // en: startBulk() chunks in flight (0 = off, max 32) / ja: startBulk() の同時送信チャンク数（0 = 無効、最大 32）
+  cfg.bulkIdleTimeoutMs = 30000;                        // en: fail a bulk session without progress / ja: 進まないバルクセッションを失敗にする時間
+
+  // en: Congestion control (needs enableAppAck; PerPeer also needs sendWindow > 1)
+  // ja: 輻輳制御（enableAppAck が必要。PerPeer は sendWindow > 1 も必要）
+  cfg.congestionControl = EspNowBus::CongestionMode::Off; // en: AIMD window (Off / PerPeer / Group) / ja: AIMD 窓（Off / PerPeer / Group）
 
   // en: JOIN / heartbeat
   // ja: JOIN とハートビート
   cfg.autoJoinIntervalMs = 30000;  // en: periodic JOIN interval ms / ja: 定期 JOIN 間隔 ms
   cfg.heartbeatIntervalMs = 10000; // en: heartbeat ping interval / ja: ハートビート ping 間隔
+  cfg.circuitBreakerFailures = 0;  // en: consecutive failures that open a peer's circuit (0 = off) / ja: 回路を開く連続失敗回数（0 = 無効）
+  cfg.circuitProbeIntervalMs = 1000; // en: probe cadence while open / ja: 回路が開いている間の確認周期
 
   // en: Task config
   // ja: タスク設定
@@ -50,6 +50,15 @@ void onSendResult(const uint8_t *mac, EspNowBus::SendStatus status)
   case EspNowBus::AppAckReceived:
     name = "AppAckReceived";
     break;
+  case EspNowBus::Expired:
+    name = "Expired";
+    break;
+  case EspNowBus::PeerUnavailable:
+    name = "PeerUnavailable";
+    break;
+  case EspNowBus::RateLimited:
+    name = "RateLimited";
+    break;
   }
   Serial.printf("TX to %02X:%02X:%02X:%02X:%02X:%02X status=%s\n",
                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], name);
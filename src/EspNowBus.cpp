@@ -5,6 +5,7 @@
 #include <esp_heap_caps.h>
 #include <esp_idf_version.h>
 #include <string.h>
+#include <new>
 #include <mbedtls/sha256.h>
 #include <mbedtls/md.h>
 #include "esp_log.h"
@@ -89,6 +90,40 @@ bool EspNowBus::begin(const Config &cfg)
 
     if (config_.replayWindowBcast > 32)
         config_.replayWindowBcast = 32;
+    if (config_.reassemblySlots > kMaxReassemblySlots)
+        config_.reassemblySlots = kMaxReassemblySlots;
+    if (config_.broadcastHistory > kMaxBroadcastHistory)
+        config_.broadcastHistory = kMaxBroadcastHistory;
+    if (config_.fecBlockSize > kMaxFecBlock)
+        config_.fecBlockSize = kMaxFecBlock;
+    if (config_.bulkWindow > kMaxBulkWindow)
+        config_.bulkWindow = kMaxBulkWindow;
+    if (config_.sendWindow == 0)
+        config_.sendWindow = 1;
+    if (config_.sendWindow > kMaxInFlight)
+        config_.sendWindow = kMaxInFlight;
+    // the congestion window only gates AppAck-awaiting frames and never exceeds sendWindow per peer
+    if (config_.congestionControl != CongestionMode::Off && !config_.enableAppAck)
+        ESP_LOGW(TAG, "congestionControl has no effect without enableAppAck");
+    else if (config_.congestionControl == CongestionMode::PerPeer && config_.sendWindow == 1)
+        ESP_LOGW(TAG, "congestionControl PerPeer has no effect with sendWindow 1");
+    if (config_.appAckDelayMs > 0 && !config_.useEncryption)
+    {
+        // DataUnicast carries no HMAC, so a piggybacked AppAck is only trusted under ESP-NOW encryption
+        ESP_LOGW(TAG, "appAckDelayMs needs useEncryption, sending AppAcks immediately");
+        config_.appAckDelayMs = 0;
+    }
+    if (config_.retryDelayMaxMs < config_.retryDelayMs)
+        config_.retryDelayMaxMs = config_.retryDelayMs;
+    if (config_.rtoMinMs == 0)
+        config_.rtoMinMs = 1;
+    if (config_.rtoMaxMs < config_.rtoMinMs)
+        config_.rtoMaxMs = config_.rtoMinMs;
+    if (config_.appAckDelayMs >= config_.txTimeoutMs)
+    {
+        config_.appAckDelayMs = static_cast<uint16_t>(config_.txTimeoutMs / 2);
+        ESP_LOGW(TAG, "appAckDelayMs clipped to %u (below txTimeoutMs)", config_.appAckDelayMs);
+    }
 
     WiFi.mode(WIFI_STA);
     int8_t configuredChannel = config_.channel;
@@ -173,7 +208,17 @@ bool EspNowBus::begin(const Config &cfg)
     // seed RNG for counters
     esp_fill_random(&msgCounter_, sizeof(msgCounter_));
     esp_fill_random(&broadcastSeq_, sizeof(broadcastSeq_));
+    esp_fill_random(&largeMsgId_, sizeof(largeMsgId_));
+    esp_fill_random(&bcastDataSeq_, sizeof(bcastDataSeq_));
+    for (auto &h : bcastHistory_)
+        h = BcastHistory{};
+    for (auto &s : senders_)
+        s = SenderWindow{};
     lastReseedMs_ = millis();
+    timerReset(lastReseedMs_);
+    armTimer(kTimerReseed, lastReseedMs_ + kReseedIntervalMs);
+    if (config_.autoJoinIntervalMs > 0)
+        armTimer(kTimerAutoJoin, lastAutoJoinMs_ + config_.autoJoinIntervalMs);
 
     // Ensure broadcast peer exists
     const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -183,25 +228,119 @@ bool EspNowBus::begin(const Config &cfg)
     applyPeerRate(broadcastMac);
 #endif
 
-    // Allocate payload pool
-    poolCount_ = config_.maxQueueLength;
-    payloadPool_ = static_cast<uint8_t *>(heap_caps_malloc(config_.maxPayloadBytes * poolCount_, MALLOC_CAP_DEFAULT));
-    bufferUsed_ = static_cast<bool *>(heap_caps_malloc(poolCount_ * sizeof(bool), MALLOC_CAP_DEFAULT));
-    if (!payloadPool_ || !bufferUsed_)
+    // Allocate payload pool: small and medium classes for short frames, then full-size buffers
+    // (plus one per broadcast history entry, which pins its buffer until overwritten, and one for the open FEC block's parity)
+    const uint16_t classSize[kBufferClassCount] = {kSmallBufferBytes, kMediumBufferBytes, config_.maxPayloadBytes};
+    const uint16_t classCount[kBufferClassCount] = {config_.smallBufferCount, config_.mediumBufferCount,
+                                                    static_cast<uint16_t>(config_.maxQueueLength + config_.broadcastHistory + (config_.fecBlockSize > 0 ? 1 : 0))};
+    size_t poolBytes = 0;
+    poolCount_ = 0;
+    for (size_t c = 0; c < kBufferClassCount; ++c)
+    {
+        BufferClass &bc = bufClasses_[c];
+        bc = BufferClass{};
+        bc.size = classSize[c];
+        // a class no smaller than a full frame would only duplicate the last one
+        bc.count = (c + 1 < kBufferClassCount && classSize[c] >= config_.maxPayloadBytes) ? 0 : classCount[c];
+        bc.first = static_cast<uint16_t>(poolCount_);
+        bc.offset = poolBytes;
+        poolCount_ += bc.count;
+        poolBytes += static_cast<size_t>(bc.size) * bc.count;
+    }
+    payloadPool_ = static_cast<uint8_t *>(heap_caps_malloc(poolBytes, MALLOC_CAP_DEFAULT));
+    bufferWords_ = (poolCount_ + 31) / 32;
+    bufferFree_ = static_cast<std::atomic<uint32_t> *>(heap_caps_malloc(bufferWords_ * sizeof(std::atomic<uint32_t>), MALLOC_CAP_DEFAULT));
+    bufferRefs_ = static_cast<std::atomic<uint8_t> *>(heap_caps_malloc(poolCount_ * sizeof(std::atomic<uint8_t>), MALLOC_CAP_DEFAULT));
+    if (!payloadPool_ || !bufferFree_ || !bufferRefs_)
     {
         ESP_LOGE(TAG, "buffer allocation failed");
         end(false, false);
         return false;
     }
-    memset(bufferUsed_, 0, poolCount_);
+    for (size_t w = 0; w < bufferWords_; ++w)
+    {
+        size_t bits = poolCount_ - w * 32;
+        new (&bufferFree_[w]) std::atomic<uint32_t>(bits >= 32 ? 0xFFFFFFFFu : ((1u << bits) - 1));
+    }
+    for (size_t i = 0; i < poolCount_; ++i)
+    {
+        new (&bufferRefs_[i]) std::atomic<uint8_t>(0);
+    }
 
-    sendQueue_ = xQueueCreate(config_.maxQueueLength, sizeof(TxItem));
-    if (!sendQueue_)
+    bool semOk = true;
+    for (size_t c = 0; c < kBufferClassCount; ++c)
+    {
+        BufferClass &bc = bufClasses_[c];
+        if (bc.count == 0)
+            continue;
+        bc.space = xSemaphoreCreateCounting(bc.count, bc.count);
+        semOk = semOk && bc.space;
+    }
+    // one descriptor per buffer, plus a spare set for sendToAllPeers fan-outs (one buffer, many descriptors)
+    const size_t nodeCount = poolCount_ + kFanoutNodes;
+    fanoutNodesFree_ = kFanoutNodes;
+    txNodes_ = static_cast<TxNode *>(heap_caps_malloc(nodeCount * sizeof(TxNode), MALLOC_CAP_DEFAULT));
+    if (!semOk || !txNodes_)
     {
         ESP_LOGE(TAG, "queue allocation failed");
         end(false, false);
         return false;
     }
+    for (size_t i = 0; i < nodeCount; ++i)
+    {
+        txNodes_[i].next = (i + 1 < nodeCount) ? static_cast<int16_t>(i + 1) : -1;
+    }
+    txFreeNode_ = 0;
+    txQueued_ = 0;
+    for (size_t i = 0; i < kMaxLanes; ++i)
+    {
+        lanes_[i] = TxLane{};
+    }
+    for (auto &r : reassembly_)
+        r = Reassembly{};
+    if (config_.reassemblySlots > 0)
+    {
+        reassemblyPool_ = static_cast<uint8_t *>(heap_caps_malloc(static_cast<size_t>(config_.reassemblySlots) * config_.maxMessageBytes, MALLOC_CAP_DEFAULT));
+        if (!reassemblyPool_)
+        {
+            ESP_LOGE(TAG, "reassembly allocation failed");
+            end(false, false);
+            return false;
+        }
+        for (size_t i = 0; i < config_.reassemblySlots; ++i)
+            reassembly_[i].data = reassemblyPool_ + i * config_.maxMessageBytes;
+    }
+    bulkTx_ = BulkTx{};
+    bulkRx_ = BulkRx{};
+    if (config_.bulkWindow > 0)
+    {
+        bulkRxPool_ = static_cast<uint8_t *>(heap_caps_malloc(static_cast<size_t>(config_.bulkWindow) * bulkChunkSize(), MALLOC_CAP_DEFAULT));
+        if (!bulkRxPool_)
+        {
+            ESP_LOGE(TAG, "bulk buffer allocation failed");
+            end(false, false);
+            return false;
+        }
+    }
+    for (auto &b : fecRx_)
+        b = FecRx{};
+    fecTxCount_ = 0;
+    fecTxSpan_ = 0;
+    fecTxBufIdx_ = -1;
+    if (config_.fecBlockSize > 0)
+    {
+        const size_t fecBytes = kFecRxSlots * static_cast<size_t>(frameLimit());
+        fecPool_ = static_cast<uint8_t *>(heap_caps_malloc(fecBytes, MALLOC_CAP_DEFAULT));
+        if (!fecPool_)
+        {
+            ESP_LOGE(TAG, "FEC buffer allocation failed");
+            end(false, false);
+            return false;
+        }
+        memset(fecPool_, 0, fecBytes);
+        for (size_t i = 0; i < kFecRxSlots; ++i)
+            fecRx_[i].acc = fecPool_ + i * frameLimit();
+    }
 
     BaseType_t created = pdFAIL;
     if (config_.taskCore < 0)
@@ -220,8 +359,9 @@ bool EspNowBus::begin(const Config &cfg)
         end(false, false);
         return false;
     }
-    ESP_LOGI(TAG, "begin success (enc=%d, queue=%u, payload=%u, ch=%d, phy=%d)",
-             config_.useEncryption, config_.maxQueueLength, config_.maxPayloadBytes,
+    ESP_LOGI(TAG, "begin success (enc=%d, queue=%u+%u+%u, pool=%uB, payload=%u, window=%u, ch=%d, phy=%d)",
+             config_.useEncryption, bufClasses_[2].count, bufClasses_[1].count, bufClasses_[0].count,
+             static_cast<unsigned>(poolBytes), config_.maxPayloadBytes, config_.sendWindow,
              static_cast<int>(config_.channel), static_cast<int>(config_.phyRate));
     return true;
 }
@@ -274,44 +414,84 @@ void EspNowBus::end(bool stopWiFi, bool sendLeave)
     }
 
     // Drain queued buffers
-    if (sendQueue_)
+    for (size_t i = 0; i < kMaxLanes && txNodes_; ++i)
     {
-        TxItem tmp{};
-        while (xQueueReceive(sendQueue_, &tmp, 0) == pdTRUE)
+        for (size_t c = 0; c < kPriorityCount; ++c)
         {
-            freeBuffer(tmp.bufferIndex);
+            for (int16_t n = lanes_[i].head[c]; n >= 0; n = txNodes_[n].next)
+            {
+                freeBuffer(txNodes_[n].item.bufferIndex);
+            }
         }
+        lanes_[i] = TxLane{};
     }
-    if (txInFlight_)
+    txQueued_ = 0;
+    for (size_t i = 0; i < kMaxInFlight; ++i)
     {
-        freeBuffer(currentTx_.bufferIndex);
-        txInFlight_ = false;
+        if (!inflight_[i].inUse)
+            continue;
+        freeBuffer(inflight_[i].item.bufferIndex);
+        inflight_[i].inUse = false;
     }
+    phySlot_ = -1;
 
     if (sendLeave)
     {
         sendLeaveOnce();
     }
 
-    if (sendQueue_)
+    if (txNodes_)
+    {
+        heap_caps_free(txNodes_);
+        txNodes_ = nullptr;
+    }
+    for (size_t c = 0; c < kBufferClassCount; ++c)
     {
-        vQueueDelete(sendQueue_);
-        sendQueue_ = nullptr;
+        if (bufClasses_[c].space)
+        {
+            vSemaphoreDelete(bufClasses_[c].space);
+            bufClasses_[c].space = nullptr;
+        }
     }
     if (payloadPool_)
     {
         heap_caps_free(payloadPool_);
         payloadPool_ = nullptr;
     }
-    if (bufferUsed_)
+    if (bufferFree_)
+    {
+        heap_caps_free(bufferFree_);
+        bufferFree_ = nullptr;
+        bufferWords_ = 0;
+    }
+    if (bufferRefs_)
     {
-        heap_caps_free(bufferUsed_);
-        bufferUsed_ = nullptr;
+        heap_caps_free(bufferRefs_);
+        bufferRefs_ = nullptr;
     }
     instance_ = nullptr;
     esp_now_unregister_send_cb();
     esp_now_unregister_recv_cb();
     esp_now_deinit();
+    if (reassemblyPool_)
+    {
+        heap_caps_free(reassemblyPool_);
+        reassemblyPool_ = nullptr;
+    }
+    if (bulkRxPool_)
+    {
+        heap_caps_free(bulkRxPool_);
+        bulkRxPool_ = nullptr;
+    }
+    if (fecPool_)
+    {
+        heap_caps_free(fecPool_);
+        fecPool_ = nullptr;
+    }
+    fecTxBufIdx_ = -1;
+    fecTxCount_ = 0;
+    bulkTx_.active = false;
+    bulkRx_.active = false;
     if (stopWiFi)
     {
         WiFi.mode(WIFI_OFF);
@@ -321,43 +501,257 @@ void EspNowBus::end(bool stopWiFi, bool sendLeave)
 
 bool EspNowBus::sendTo(const uint8_t mac[6], const void *data, size_t len, uint32_t timeoutMs)
 {
-    if (!mac)
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return sendTo(mac, data, len, opts);
+}
+
+bool EspNowBus::sendToAllPeers(const void *data, size_t len, uint32_t timeoutMs)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return sendToAllPeers(data, len, opts);
+}
+
+bool EspNowBus::broadcast(const void *data, size_t len, uint32_t timeoutMs)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return broadcast(data, len, opts);
+}
+
+bool EspNowBus::sendTo(const uint8_t mac[6], const void *data, size_t len, const SendOptions &opts)
+{
+    const SendSegment segment{data, len};
+    return sendTo(mac, &segment, 1, opts);
+}
+
+bool EspNowBus::sendTo(const uint8_t mac[6], const SendSegment *segments, size_t count, uint32_t timeoutMs)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return sendTo(mac, segments, count, opts);
+}
+
+bool EspNowBus::sendTo(const uint8_t mac[6], const SendSegment *segments, size_t count, const SendOptions &opts)
+{
+    if (!mac || (!segments && count > 0))
         return false;
+    const size_t len = segmentsLength(segments, count);
     char timeoutBuf[24];
-    ESP_LOGD(TAG, "sendTo mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u timeout=%s",
+    ESP_LOGD(TAG, "sendTo mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u timeout=%s prio=%u",
              mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
              static_cast<unsigned>(len),
-             timeoutLabel(timeoutMs, timeoutBuf, sizeof(timeoutBuf)));
-    return enqueueCommon(Dest::Unicast, PacketType::DataUnicast, mac, data, len, timeoutMs);
+             timeoutLabel(opts.timeoutMs, timeoutBuf, sizeof(timeoutBuf)),
+             static_cast<unsigned>(opts.priority));
+    if (rejectIfCircuitOpen(mac) || rejectIfOverBudget(mac, len))
+        return false;
+    return enqueueCommon(Dest::Unicast, PacketType::DataUnicast, mac, segments, count, opts);
 }
 
-bool EspNowBus::sendToAllPeers(const void *data, size_t len, uint32_t timeoutMs)
+bool EspNowBus::sendToAllPeers(const void *data, size_t len, const SendOptions &opts)
 {
     char timeoutBuf[24];
     ESP_LOGD(TAG, "sendToAllPeers len=%u timeout=%s",
              static_cast<unsigned>(len),
-             timeoutLabel(timeoutMs, timeoutBuf, sizeof(timeoutBuf)));
+             timeoutLabel(opts.timeoutMs, timeoutBuf, sizeof(timeoutBuf)));
+    uint8_t macs[kMaxPeers][6];
+    size_t count = 0;
     bool ok = true;
     for (size_t i = 0; i < kMaxPeers; ++i)
     {
         if (!peers_[i].inUse)
             continue;
-        if (!sendTo(peers_[i].mac, data, len, timeoutMs))
+        if (rejectIfCircuitOpen(peers_[i].mac) || rejectIfOverBudget(peers_[i].mac, len))
         {
             ok = false;
+            continue;
+        }
+        memcpy(macs[count++], peers_[i].mac, 6);
+    }
+    if (count == 0)
+        return ok;
+    if (count == 1)
+        return sendTo(macs[0], data, len, opts) && ok;
+
+    // One payload copy shared by a descriptor per peer; the buffer returns to the pool when the last
+    // peer completes, and each peer still gets its own msgId, AppAck, retries and onSendResult.
+    // Descriptors are reserved first, so the fan-out either reaches every peer's queue or none.
+    bool reserved = false;
+    portENTER_CRITICAL(&txLock_);
+    if (fanoutNodesFree_ >= count)
+    {
+        fanoutNodesFree_ -= static_cast<uint16_t>(count);
+        reserved = true;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    SendStatus failed = SendStatus::DroppedFull;
+    int16_t bufIdx = reserved ? acquireBuffer(PacketType::DataUnicast, macs[0], len, opts.timeoutMs, &failed) : -1;
+    if (bufIdx < 0)
+    {
+        if (reserved)
+        {
+            portENTER_CRITICAL(&txLock_);
+            fanoutNodesFree_ += static_cast<uint16_t>(count);
+            portEXIT_CRITICAL(&txLock_);
+        }
+        else
+        {
+            ESP_LOGW(TAG, "sendToAllPeers: fan-out descriptors in use, drop");
         }
+        for (size_t i = 0; i < count && onSendResult_; ++i)
+            onSendResult_(macs[i], failed);
+        return false;
+    }
+    memcpy(bufferPtr(static_cast<uint16_t>(bufIdx)) + kHeaderSize, data, len);
+    bufferRefs_[bufIdx].store(static_cast<uint8_t>(count), std::memory_order_release);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        TxItem item{};
+        item.bufferIndex = static_cast<uint16_t>(bufIdx);
+        item.len = static_cast<uint16_t>(kHeaderSize + len);
+        item.msgId = allocMsgId();
+        item.seq = 0;
+        item.dest = Dest::Unicast;
+        item.pktType = PacketType::DataUnicast;
+        item.priority = (static_cast<size_t>(opts.priority) < kPriorityCount) ? opts.priority : Priority::Bulk;
+        item.isRetry = false;
+        memcpy(item.mac, macs[i], 6);
+        item.expectAck = config_.enableAppAck;
+        item.shared = true;
+        item.coalesceKey = opts.coalesceKey;
+        item.hasExpiry = opts.ttlMs > 0;
+        item.expiresMs = millis() + opts.ttlMs;
+        if (!queueTxItem(item))
+            ok = false;
     }
     return ok;
 }
 
-bool EspNowBus::broadcast(const void *data, size_t len, uint32_t timeoutMs)
+bool EspNowBus::sendLarge(const uint8_t mac[6], const void *data, size_t len, uint32_t timeoutMs)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return sendLarge(mac, data, len, opts);
+}
+
+bool EspNowBus::sendLarge(const uint8_t mac[6], const void *data, size_t len, const SendOptions &opts)
+{
+    if (!mac || (!data && len > 0))
+        return false;
+    const size_t fragSize = frameLimit() - frameHeaderLen(PacketType::DataFragment) - sizeof(FragmentHeader);
+    const size_t count = (len == 0) ? 1 : (len + fragSize - 1) / fragSize;
+    if (len > config_.maxMessageBytes || count > kMaxFragments)
+    {
+        if (onSendResult_)
+            onSendResult_(mac, SendStatus::TooLarge);
+        ESP_LOGW(TAG, "message too large (%u > %u)", static_cast<unsigned>(len), static_cast<unsigned>(config_.maxMessageBytes));
+        return false;
+    }
+    ESP_LOGD(TAG, "sendLarge mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u fragments=%u",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+             static_cast<unsigned>(len), static_cast<unsigned>(count));
+    if (rejectIfCircuitOpen(mac) || rejectIfOverBudget(mac, fragSize))
+        return false;
+    FragmentHeader fh{};
+    portENTER_CRITICAL(&txLock_);
+    fh.messageId = ++largeMsgId_;
+    portEXIT_CRITICAL(&txLock_);
+    fh.fragSize = static_cast<uint16_t>(fragSize);
+    fh.totalLen = static_cast<uint32_t>(len);
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < count; ++i)
+    {
+        fh.offset = static_cast<uint32_t>(i * fragSize);
+        size_t chunk = len - fh.offset < fragSize ? len - fh.offset : fragSize;
+        int16_t bufIdx = acquireBuffer(PacketType::DataFragment, mac, sizeof(fh) + chunk, opts.timeoutMs);
+        if (bufIdx < 0)
+            return false; // the receiver drops the partial message after reassemblyTimeoutMs
+        uint8_t *dst = bufferPtr(static_cast<uint16_t>(bufIdx)) + frameHeaderLen(PacketType::DataFragment);
+        memcpy(dst, &fh, sizeof(fh));
+        if (chunk > 0)
+            memcpy(dst + sizeof(fh), src + fh.offset, chunk);
+        if (!finalizeAndQueue(Dest::Unicast, PacketType::DataFragment, mac, static_cast<uint16_t>(bufIdx), sizeof(fh) + chunk, opts))
+            return false;
+    }
+    return true;
+}
+
+bool EspNowBus::startBulk(const uint8_t mac[6], uint32_t totalLen, BulkSourceCallback source)
+{
+    if (!mac || !source || totalLen == 0 || config_.bulkWindow == 0 || !sendTask_)
+        return false;
+    if (rejectIfCircuitOpen(mac))
+        return false;
+    BulkTx tx{};
+    tx.active = true;
+    memcpy(tx.mac, mac, 6);
+    esp_fill_random(&tx.transferId, sizeof(tx.transferId));
+    tx.totalLen = totalLen;
+    tx.chunkSize = bulkChunkSize();
+    tx.chunkCount = totalLen / tx.chunkSize + (totalLen % tx.chunkSize ? 1 : 0);
+    tx.progressMs = millis();
+    tx.deadlineMs = tx.progressMs;
+    tx.source = source;
+    bool started = false;
+    portENTER_CRITICAL(&txLock_);
+    if (!bulkTx_.active)
+    {
+        bulkTx_ = tx;
+        started = true;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    if (!started)
+    {
+        ESP_LOGW(TAG, "bulk session already running");
+        return false;
+    }
+    ESP_LOGI(TAG, "bulk start id=%08X len=%u chunks=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             static_cast<unsigned>(tx.transferId), static_cast<unsigned>(totalLen), static_cast<unsigned>(tx.chunkCount),
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    wakeSendTask();
+    return true;
+}
+
+void EspNowBus::cancelBulk()
+{
+    // chunks already queued still go out; the receiver lets the session go after bulkIdleTimeoutMs
+    if (bulkTx_.active)
+        finishBulk(BulkEvent::Cancelled);
+}
+
+bool EspNowBus::bulkActive() const
+{
+    return bulkTx_.active;
+}
+
+bool EspNowBus::broadcast(const void *data, size_t len, const SendOptions &opts)
+{
+    const SendSegment segment{data, len};
+    return broadcast(&segment, 1, opts);
+}
+
+bool EspNowBus::broadcast(const SendSegment *segments, size_t count, uint32_t timeoutMs)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return broadcast(segments, count, opts);
+}
+
+bool EspNowBus::broadcast(const SendSegment *segments, size_t count, const SendOptions &opts)
 {
     static const uint8_t bcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (!segments && count > 0)
+        return false;
+    const size_t len = segmentsLength(segments, count);
     char timeoutBuf[24];
     ESP_LOGD(TAG, "broadcast len=%u timeout=%s",
              static_cast<unsigned>(len),
-             timeoutLabel(timeoutMs, timeoutBuf, sizeof(timeoutBuf)));
-    return enqueueCommon(Dest::Broadcast, PacketType::DataBroadcast, bcast, data, len, timeoutMs);
+             timeoutLabel(opts.timeoutMs, timeoutBuf, sizeof(timeoutBuf)));
+    if (rejectIfOverBudget(bcast, len))
+        return false;
+    return enqueueCommon(Dest::Broadcast, PacketType::DataBroadcast, bcast, segments, count, opts);
 }
 
 void EspNowBus::onReceive(ReceiveCallback cb)
@@ -380,6 +774,16 @@ void EspNowBus::onJoinEvent(JoinEventCallback cb)
     onJoinEvent_ = cb;
 }
 
+void EspNowBus::onBulkProgress(BulkProgressCallback cb)
+{
+    onBulkProgress_ = cb;
+}
+
+void EspNowBus::onBulkReceive(BulkReceiveCallback cb)
+{
+    onBulkReceive_ = cb;
+}
+
 bool EspNowBus::addPeer(const uint8_t mac[6])
 {
     if (!mac)
@@ -418,7 +822,12 @@ bool EspNowBus::removePeer(const uint8_t mac[6])
     {
         peers_[idx].inUse = false;
         peers_[idx].ready = false;
+        cancelTimer(kTimerPeerBase + static_cast<size_t>(idx));
+        cancelTimer(kTimerProbeBase + static_cast<size_t>(idx));
+        cancelTimer(kTimerAckBase + static_cast<size_t>(idx));
     }
+    // a peer that comes back (e.g. rebooted with new counters) is learnt afresh
+    forgetSender(mac);
     return true;
 }
 
@@ -478,21 +887,42 @@ bool EspNowBus::sendJoinRequest(const uint8_t targetMac[6], uint32_t timeoutMs)
     ESP_LOGD(TAG, "sendJoinRequest nonceA=%02X%02X... target=%02X:%02X:%02X:%02X:%02X:%02X",
              payload.nonceA[0], payload.nonceA[1],
              tgt[0], tgt[1], tgt[2], tgt[3], tgt[4], tgt[5]);
-    return enqueueCommon(Dest::Broadcast, PacketType::ControlJoinReq, kBroadcastMac, &payload, sizeof(payload), timeoutMs);
+    return enqueueCommon(Dest::Broadcast, PacketType::ControlJoinReq, kBroadcastMac, &payload, sizeof(payload), timeoutMs, Priority::Control);
 }
 
 uint16_t EspNowBus::sendQueueFree() const
 {
-    if (!sendQueue_)
+    // only full-size buffers can take any payload; small/medium ones are not promised capacity
+    const BufferClass &full = bufClasses_[kBufferClassCount - 1];
+    if (!txNodes_ || !full.space)
         return 0;
-    return static_cast<uint16_t>(uxQueueSpacesAvailable(sendQueue_));
+    return static_cast<uint16_t>(uxSemaphoreGetCount(full.space));
 }
 
 uint16_t EspNowBus::sendQueueSize() const
 {
-    if (!sendQueue_)
+    if (!txNodes_)
+        return 0;
+    return txQueued_;
+}
+
+uint16_t EspNowBus::sendQueueFree(const uint8_t mac[6]) const
+{
+    if (!txNodes_ || !mac)
+        return 0;
+    uint16_t used = sendQueueSize(mac);
+    uint16_t cap = perPeerQueueCap();
+    uint16_t laneFree = (used < cap) ? static_cast<uint16_t>(cap - used) : 0;
+    uint16_t poolFree = sendQueueFree();
+    return laneFree < poolFree ? laneFree : poolFree;
+}
+
+uint16_t EspNowBus::sendQueueSize(const uint8_t mac[6]) const
+{
+    if (!txNodes_ || !mac)
         return 0;
-    return static_cast<uint16_t>(uxQueueMessagesWaiting(sendQueue_));
+    int li = findLane(mac);
+    return li >= 0 ? lanes_[li].count : 0;
 }
 
 bool EspNowBus::initPeers(const uint8_t peers[][6], size_t count)
@@ -532,12 +962,21 @@ int EspNowBus::ensurePeer(const uint8_t mac[6])
             peers_[i].inUse = true;
             peers_[i].ready = false;
             memcpy(peers_[i].mac, mac, 6);
-            peers_[i].lastMsgId = 0;
+            peers_[i].rxMsgValid = false;
+            peers_[i].rxMsgWindow = 0;
             peers_[i].lastBroadcastBase = 0;
             peers_[i].bcastWindow = 0;
             peers_[i].lastSeenMs = millis();
             peers_[i].heartbeatStage = 0;
             peers_[i].nonceValid = false;
+            peers_[i].ackPending = false;
+            peers_[i].appAckValid = false;
+            peers_[i].rttValid = false;
+            peers_[i].rtoBackoff = 0;
+            peers_[i].cwndQ8 = 256;
+            peers_[i].cwndCutMs = 0;
+            peers_[i].failStreak = 0;
+            peers_[i].circuitOpen = false;
             esp_now_peer_info_t info = makePeerInfo(mac, config_.useEncryption, derived_.lmk);
             esp_err_t err = esp_now_add_peer(&info);
             if (err != ESP_OK && err != ESP_ERR_ESPNOW_EXIST)
@@ -551,29 +990,68 @@ int EspNowBus::ensurePeer(const uint8_t mac[6])
             if (err == ESP_OK)
                 applyPeerRate(mac);
 #endif
+            cancelTimer(kTimerProbeBase + i);
+            cancelTimer(kTimerAckBase + i);
+            if (config_.heartbeatIntervalMs > 0)
+                armTimer(kTimerPeerBase + i, peers_[i].lastSeenMs + config_.heartbeatIntervalMs);
+            wakeSendTask(); // its heartbeat deadline joins the send task's wait
             return static_cast<int>(i);
         }
     }
     return -1;
 }
 
+int EspNowBus::bufferClassOf(uint16_t idx) const
+{
+    for (size_t c = 0; c < kBufferClassCount; ++c)
+    {
+        const BufferClass &bc = bufClasses_[c];
+        if (idx >= bc.first && idx < bc.first + bc.count)
+            return static_cast<int>(c);
+    }
+    return -1;
+}
+
+uint16_t EspNowBus::bufferCapacity(uint16_t idx) const
+{
+    int c = bufferClassOf(idx);
+    return c >= 0 ? bufClasses_[c].size : 0;
+}
+
 uint8_t *EspNowBus::bufferPtr(uint16_t idx)
 {
-    if (!payloadPool_ || idx >= poolCount_)
+    int c = payloadPool_ ? bufferClassOf(idx) : -1;
+    if (c < 0)
         return nullptr;
-    return payloadPool_ + (static_cast<size_t>(idx) * config_.maxPayloadBytes);
+    const BufferClass &bc = bufClasses_[c];
+    return payloadPool_ + bc.offset + static_cast<size_t>(idx - bc.first) * bc.size;
 }
 
-int16_t EspNowBus::allocBuffer()
+int16_t EspNowBus::allocBuffer(size_t cls)
 {
-    if (!bufferUsed_)
+    // Callers hold one of the class semaphore counts, so a free bit exists; claim it with CAS
+    // so sendTo() from several tasks and AppAck/Pong enqueues from the Wi-Fi task never share a buffer.
+    const BufferClass &bc = bufClasses_[cls];
+    if (!bufferFree_ || bc.count == 0)
         return -1;
-    for (size_t i = 0; i < poolCount_; ++i)
+    const size_t first = bc.first;
+    const size_t last = first + bc.count; // exclusive
+    for (size_t w = first / 32; w * 32 < last; ++w)
     {
-        if (!bufferUsed_[i])
+        uint32_t mask = 0xFFFFFFFFu;
+        if (first > w * 32)
+            mask &= 0xFFFFFFFFu << (first - w * 32);
+        if (last < (w + 1) * 32)
+            mask &= (1u << (last - w * 32)) - 1;
+        uint32_t cur = bufferFree_[w].load(std::memory_order_relaxed);
+        while (cur & mask)
         {
-            bufferUsed_[i] = true;
-            return static_cast<int16_t>(i);
+            uint32_t bit = static_cast<uint32_t>(__builtin_ctz(cur & mask));
+            if (bufferFree_[w].compare_exchange_weak(cur, cur & ~(1u << bit), std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                bufferRefs_[w * 32 + bit].store(1, std::memory_order_relaxed);
+                return static_cast<int16_t>(w * 32 + bit);
+            }
         }
     }
     return -1;
@@ -581,12 +1059,40 @@ int16_t EspNowBus::allocBuffer()
 
 void EspNowBus::freeBuffer(uint16_t idx)
 {
-    if (!bufferUsed_ || idx >= poolCount_)
+    int c = bufferFree_ ? bufferClassOf(idx) : -1;
+    if (c < 0)
         return;
-    bufferUsed_[idx] = false;
+    // a fan-out buffer stays claimed until its last descriptor lets go
+    if (bufferRefs_[idx].fetch_sub(1, std::memory_order_acq_rel) > 1)
+        return;
+    bufferFree_[idx / 32].fetch_or(1u << (idx % 32), std::memory_order_release);
+    if (bufClasses_[c].space)
+        xSemaphoreGive(bufClasses_[c].space);
+}
+
+bool EspNowBus::packetNeedsAuth(uint8_t pktType)
+{
+    return pktType == PacketType::DataBroadcast || pktType == PacketType::ControlJoinReq || pktType == PacketType::ControlJoinAck || pktType == PacketType::ControlAppAck || pktType == PacketType::ControlHeartbeat || pktType == PacketType::ControlLeave ||
+           pktType == PacketType::ControlNack || pktType == PacketType::DataFecParity;
+}
+
+size_t EspNowBus::frameHeaderLen(PacketType pktType) const
+{
+    // reliable broadcast adds dataSeq(2) after groupId, FEC also the frame's position in its block
+    size_t ext = 0;
+    if (pktType == PacketType::DataBroadcast)
+        ext = (config_.fecBlockSize > 0) ? kFecDataExt : (config_.broadcastHistory > 0 ? 2 : 0);
+    return kHeaderSize + (packetNeedsAuth(pktType) ? 4 : 0) + ext;
+}
+
+size_t EspNowBus::fecReserve(PacketType pktType) const
+{
+    // the parity frame carries first/count/lenXor where its members carry dataSeq/position,
+    // so members stay that much shorter for the parity to fit in one frame
+    return (pktType == PacketType::DataBroadcast && config_.fecBlockSize > 0) ? sizeof(FecParityHeader) - kFecDataExt : 0;
 }
 
-bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const void *data, size_t len, uint32_t timeoutMs)
+uint16_t EspNowBus::frameLimit() const
 {
     // enforce payload size bounds by IDF version and header overhead
     uint16_t maxLen = config_.maxPayloadBytes;
@@ -599,49 +1105,109 @@ bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac,
 #endif
     if (maxLen < kHeaderSize + 4)
         maxLen = kHeaderSize + 4;
+    return maxLen;
+}
 
+int16_t EspNowBus::acquireBuffer(PacketType pktType, const uint8_t *mac, size_t len, uint32_t timeoutMs, SendStatus *failed)
+{
+    // with `failed` set the caller reports the drop itself (a fan-out reports it once per peer)
+    auto reportFail = [&](SendStatus status)
+    {
+        if (failed)
+            *failed = status;
+        else if (onSendResult_)
+            onSendResult_(mac, status);
+    };
     if (xPortInIsrContext())
     {
         ESP_LOGE(TAG, "send called from ISR not supported");
-        return false;
+        return -1;
     }
-    if (!sendQueue_)
-        return false;
-    const bool needsAuth = (pktType == PacketType::DataBroadcast || pktType == PacketType::ControlJoinReq || pktType == PacketType::ControlJoinAck || pktType == PacketType::ControlAppAck || pktType == PacketType::ControlHeartbeat || pktType == PacketType::ControlLeave);
-    const size_t totalLen = kHeaderSize + (needsAuth ? (4 + kAuthTagLen) : 0) + len;
+    if (!txNodes_)
+        return -1;
+    const uint16_t maxLen = frameLimit();
+    const size_t totalLen = frameHeaderLen(pktType) + (packetNeedsAuth(pktType) ? kAuthTagLen : 0) + len + fecReserve(pktType);
     if (totalLen > maxLen)
     {
-        if (onSendResult_)
-            onSendResult_(mac, SendStatus::TooLarge);
+        reportFail(SendStatus::TooLarge);
         ESP_LOGW(TAG, "payload too large (%u > %u)", static_cast<unsigned>(totalLen), maxLen);
-        return false;
+        return -1;
+    }
+    TickType_t ticks;
+    if (timeoutMs == kUseDefault)
+    {
+        ticks = pdMS_TO_TICKS(config_.sendTimeoutMs);
+    }
+    else if (timeoutMs == portMAX_DELAY)
+    {
+        ticks = portMAX_DELAY;
+    }
+    else
+    {
+        ticks = pdMS_TO_TICKS(timeoutMs);
+    }
+    // Smallest class that fits and has a free buffer; otherwise wait for a full-size one
+    int cls = -1;
+    for (size_t c = 0; c < kBufferClassCount && cls < 0; ++c)
+    {
+        const BufferClass &bc = bufClasses_[c];
+        if (bc.space && bc.size >= totalLen && xSemaphoreTake(bc.space, 0) == pdTRUE)
+            cls = static_cast<int>(c);
+    }
+    const size_t fullCls = kBufferClassCount - 1;
+    if (cls < 0 && ticks > 0 && xSemaphoreTake(bufClasses_[fullCls].space, ticks) == pdTRUE)
+        cls = static_cast<int>(fullCls);
+    if (cls < 0)
+    {
+        reportFail(SendStatus::DroppedFull);
+        ESP_LOGW(TAG, "queue full: drop");
+        return -1;
     }
-    int16_t bufIdx = allocBuffer();
+    int16_t bufIdx = allocBuffer(static_cast<size_t>(cls));
     if (bufIdx < 0)
     {
-        if (onSendResult_)
-            onSendResult_(mac, SendStatus::DroppedFull);
+        xSemaphoreGive(bufClasses_[cls].space);
+        reportFail(SendStatus::DroppedFull);
         ESP_LOGW(TAG, "queue full: drop");
-        return false;
+        return -1;
     }
+    return bufIdx;
+}
+
+uint16_t EspNowBus::allocMsgId()
+{
+    portENTER_CRITICAL(&txLock_); // producers may run on both cores
+    uint16_t msgId = ++msgCounter_;
+    portEXIT_CRITICAL(&txLock_);
+    return msgId;
+}
 
+bool EspNowBus::finalizeAndQueue(Dest dest, PacketType pktType, const uint8_t *mac, uint16_t bufIdx, size_t len, const SendOptions &opts)
+{
+    // The payload already sits at frameHeaderLen(pktType); fill in header, groupId and tag around it
+    const bool needsAuth = packetNeedsAuth(pktType);
     uint16_t msgId = 0;
     uint16_t seq = 0;
-    if (pktType == PacketType::DataBroadcast || pktType == PacketType::ControlJoinReq || pktType == PacketType::ControlJoinAck || pktType == PacketType::ControlLeave)
+    const bool seqType = pktType == PacketType::DataBroadcast || pktType == PacketType::ControlJoinReq || pktType == PacketType::ControlJoinAck || pktType == PacketType::ControlLeave ||
+                         pktType == PacketType::DataFecParity || pktType == PacketType::ControlNack;
+    if (seqType)
     {
+        portENTER_CRITICAL(&txLock_); // producers may run on both cores
         seq = ++broadcastSeq_;
+        portEXIT_CRITICAL(&txLock_);
     }
-    else
+    else if (pktType != PacketType::DataBulk && pktType != PacketType::ControlBulkAck)
     {
-        msgId = ++msgCounter_;
+        // bulk frames are numbered by chunk; keeping them out of msgId leaves the AppAck window dense
+        msgId = allocMsgId();
     }
 
-    uint8_t *buf = bufferPtr(static_cast<uint16_t>(bufIdx));
+    uint8_t *buf = bufferPtr(bufIdx);
     buf[0] = kMagic;
     buf[1] = kVersion;
     buf[2] = pktType;
     buf[3] = 0; // flags
-    uint16_t idField = (pktType == PacketType::DataBroadcast || pktType == PacketType::ControlJoinReq || pktType == PacketType::ControlJoinAck || pktType == PacketType::ControlLeave) ? seq : msgId;
+    uint16_t idField = seqType ? seq : msgId;
     buf[4] = static_cast<uint8_t>(idField & 0xFF);
     buf[5] = static_cast<uint8_t>((idField >> 8) & 0xFF);
 
@@ -655,8 +1221,15 @@ bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac,
         buf[cursor + 3] = static_cast<uint8_t>((derived_.groupId >> 24) & 0xFF);
         cursor += 4;
     }
-
-    memcpy(buf + cursor, data, len);
+    if (pktType == PacketType::DataBroadcast && (config_.broadcastHistory > 0 || config_.fecBlockSize > 0))
+    {
+        // dataSeq (and FEC position), filled in when the frame first goes on air
+        if (config_.broadcastHistory > 0)
+            buf[3] |= kFlagReliable;
+        if (config_.fecBlockSize > 0)
+            buf[3] |= kFlagFec;
+        cursor += frameHeaderLen(pktType) - (kHeaderSize + 4);
+    }
     cursor += len;
 
     if (needsAuth)
@@ -667,70 +1240,193 @@ bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac,
     }
 
     TxItem item{};
-    item.bufferIndex = static_cast<uint16_t>(bufIdx);
+    item.bufferIndex = bufIdx;
     item.len = static_cast<uint16_t>(cursor);
     item.msgId = msgId;
     item.seq = seq;
     item.dest = dest;
     item.pktType = pktType;
+    item.priority = (static_cast<size_t>(opts.priority) < kPriorityCount) ? opts.priority : Priority::Bulk;
     item.isRetry = false;
     memcpy(item.mac, mac, 6);
-    if (config_.enableAppAck && pktType == PacketType::DataUnicast)
-    {
-        item.expectAck = true;
-        item.appAckDeadlineMs = millis() + config_.txTimeoutMs;
-    }
-    else if (pktType == PacketType::ControlAppAck)
-    {
-        item.expectAck = false;
-    }
+    item.expectAck = config_.enableAppAck && (pktType == PacketType::DataUnicast || pktType == PacketType::DataFragment);
+    // only user data frames coalesce or expire; control frames keep their own ids
+    const bool userData = pktType == PacketType::DataUnicast || pktType == PacketType::DataBroadcast;
+    item.coalesceKey = userData ? opts.coalesceKey : 0;
+    item.hasExpiry = (userData || pktType == PacketType::DataFragment) && opts.ttlMs > 0;
+    item.expiresMs = millis() + opts.ttlMs;
 
-    TickType_t ticks;
-    if (timeoutMs == kUseDefault)
-    {
-        ticks = pdMS_TO_TICKS(config_.sendTimeoutMs);
-    }
-    else if (timeoutMs == portMAX_DELAY)
-    {
-        ticks = portMAX_DELAY;
-    }
-    else
-    {
-        ticks = pdMS_TO_TICKS(timeoutMs);
-    }
-    BaseType_t ok = xQueueSend(sendQueue_, &item, ticks);
-    if (ok != pdPASS)
-    {
-        freeBuffer(item.bufferIndex);
-        if (onSendResult_)
-            onSendResult_(mac, SendStatus::DroppedFull);
+    if (!queueTxItem(item))
         return false;
-    }
-    if (onSendResult_)
-        onSendResult_(mac, SendStatus::Queued);
-    ESP_LOGV(TAG, "enqueue pkt=%u dest=%u mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u total=%u",
-             static_cast<unsigned>(pktType), static_cast<unsigned>(dest),
+    ESP_LOGV(TAG, "enqueue pkt=%u dest=%u prio=%u mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u total=%u",
+             static_cast<unsigned>(pktType), static_cast<unsigned>(dest), static_cast<unsigned>(item.priority),
              mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
              static_cast<unsigned>(len),
              static_cast<unsigned>(cursor));
     return true;
 }
 
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-void EspNowBus::onSendStatic(const wifi_tx_info_t *info, esp_now_send_status_t status)
-{
-#else
-void EspNowBus::onSendStatic(const uint8_t *mac, esp_now_send_status_t status)
+bool EspNowBus::queueTxItem(TxItem &item)
 {
-#endif
-    if (!instance_ || !instance_->sendTask_)
-        return;
-    uint32_t val = (status == ESP_NOW_SEND_SUCCESS) ? 1 : 2;
-    BaseType_t hpw = pdFALSE;
-    xTaskNotifyFromISR(instance_->sendTask_, val, eSetValueWithOverwrite, &hpw);
-    if (hpw == pdTRUE)
+    TxItem stale{};
+    const bool replaced = item.coalesceKey != 0 && replaceQueued(item, stale);
+    if (!replaced && !pushTx(item))
     {
-        portYIELD_FROM_ISR();
+        // destination lane at maxQueuePerPeer (or no lane left)
+        if (item.shared)
+        {
+            portENTER_CRITICAL(&txLock_);
+            ++fanoutNodesFree_;
+            portEXIT_CRITICAL(&txLock_);
+        }
+        freeBuffer(item.bufferIndex);
+        reportSendResult(item, SendStatus::DroppedFull);
+        ESP_LOGW(TAG, "peer queue full: drop mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 item.mac[0], item.mac[1], item.mac[2], item.mac[3], item.mac[4], item.mac[5]);
+        return false;
+    }
+    if (item.hasExpiry)
+    {
+        portENTER_CRITICAL(&txLock_);
+        if (!txExpiryPending_ || static_cast<int32_t>(item.expiresMs - txNextExpiryMs_) < 0)
+        {
+            txExpiryPending_ = true;
+            txNextExpiryMs_ = item.expiresMs;
+            armTimerLocked(kTimerQueueTtl, item.expiresMs);
+        }
+        portEXIT_CRITICAL(&txLock_);
+    }
+    if (replaced)
+    {
+        // the older value never went on air; it gives up its place in the lane to the newer one
+        if (onSendResult_)
+            onSendResult_(stale.mac, SendStatus::DroppedOldest);
+        freeBuffer(stale.bufferIndex);
+        ESP_LOGV(TAG, "coalesced key=%u id=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 static_cast<unsigned>(item.coalesceKey), static_cast<unsigned>(item.msgId ? item.msgId : item.seq),
+                 item.mac[0], item.mac[1], item.mac[2], item.mac[3], item.mac[4], item.mac[5]);
+    }
+    wakeSendTask();
+    reportSendResult(item, SendStatus::Queued);
+    return true;
+}
+
+bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const void *data, size_t len, uint32_t timeoutMs, Priority priority)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    opts.priority = priority;
+    return enqueueCommon(dest, pktType, mac, data, len, opts);
+}
+
+bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const void *data, size_t len, const SendOptions &opts)
+{
+    const SendSegment segment{data, len};
+    return enqueueCommon(dest, pktType, mac, &segment, 1, opts);
+}
+
+bool EspNowBus::enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const SendSegment *segments, size_t count, const SendOptions &opts)
+{
+    const size_t len = segmentsLength(segments, count);
+    int16_t bufIdx = acquireBuffer(pktType, mac, len, opts.timeoutMs);
+    if (bufIdx < 0)
+        return false;
+    // gather the segments right behind the header; this is the only copy of the payload
+    uint8_t *dst = bufferPtr(static_cast<uint16_t>(bufIdx)) + frameHeaderLen(pktType);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (segments[i].len == 0)
+            continue;
+        memcpy(dst, segments[i].data, segments[i].len);
+        dst += segments[i].len;
+    }
+    return finalizeAndQueue(dest, pktType, mac, static_cast<uint16_t>(bufIdx), len, opts);
+}
+
+size_t EspNowBus::segmentsLength(const SendSegment *segments, size_t count)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i)
+        len += segments[i].len;
+    return len;
+}
+
+bool EspNowBus::reserve(const uint8_t mac[6], size_t maxLen, SendReservation &out, uint32_t timeoutMs)
+{
+    SendOptions opts;
+    opts.timeoutMs = timeoutMs;
+    return reserve(mac, maxLen, out, opts);
+}
+
+bool EspNowBus::reserve(const uint8_t mac[6], size_t maxLen, SendReservation &out, const SendOptions &opts)
+{
+    out = SendReservation{};
+    if (!mac)
+        return false;
+    const bool bcast = memcmp(mac, kBroadcastMac, 6) == 0;
+    const PacketType pktType = bcast ? PacketType::DataBroadcast : PacketType::DataUnicast;
+    if ((!bcast && rejectIfCircuitOpen(mac)) || rejectIfOverBudget(mac, maxLen))
+        return false;
+    int16_t bufIdx = acquireBuffer(pktType, mac, maxLen, opts.timeoutMs);
+    if (bufIdx < 0)
+        return false;
+    const size_t overhead = frameHeaderLen(pktType) + (packetNeedsAuth(pktType) ? kAuthTagLen : 0) + fecReserve(pktType);
+    out.data = bufferPtr(static_cast<uint16_t>(bufIdx)) + frameHeaderLen(pktType);
+    size_t room = bufferCapacity(static_cast<uint16_t>(bufIdx));
+    if (room > frameLimit())
+        room = frameLimit();
+    out.capacity = room - overhead;
+    out.bufferIndex = bufIdx;
+    out.broadcast = bcast;
+    memcpy(out.mac, mac, 6);
+    out.opts = opts;
+    return true;
+}
+
+bool EspNowBus::commit(SendReservation &res, size_t len)
+{
+    if (res.bufferIndex < 0)
+        return false;
+    uint16_t bufIdx = static_cast<uint16_t>(res.bufferIndex);
+    if (len > res.capacity)
+    {
+        if (onSendResult_)
+            onSendResult_(res.mac, SendStatus::TooLarge);
+        ESP_LOGW(TAG, "commit beyond reservation (%u > %u)", static_cast<unsigned>(len), static_cast<unsigned>(res.capacity));
+        cancel(res);
+        return false;
+    }
+    const Dest dest = res.broadcast ? Dest::Broadcast : Dest::Unicast;
+    const PacketType pktType = res.broadcast ? PacketType::DataBroadcast : PacketType::DataUnicast;
+    uint8_t mac[6];
+    memcpy(mac, res.mac, 6);
+    SendOptions opts = res.opts;
+    res = SendReservation{};
+    return finalizeAndQueue(dest, pktType, mac, bufIdx, len, opts);
+}
+
+void EspNowBus::cancel(SendReservation &res)
+{
+    if (res.bufferIndex >= 0)
+        freeBuffer(static_cast<uint16_t>(res.bufferIndex));
+    res = SendReservation{};
+}
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+void EspNowBus::onSendStatic(const wifi_tx_info_t *info, esp_now_send_status_t status)
+{
+#else
+void EspNowBus::onSendStatic(const uint8_t *mac, esp_now_send_status_t status)
+{
+#endif
+    if (!instance_ || !instance_->sendTask_)
+        return;
+    uint32_t val = (status == ESP_NOW_SEND_SUCCESS) ? kNotifyTxOk : kNotifyTxFail;
+    BaseType_t hpw = pdFALSE;
+    xTaskNotifyFromISR(instance_->sendTask_, val, eSetBits, &hpw);
+    if (hpw == pdTRUE)
+    {
+        portYIELD_FROM_ISR();
     }
 }
 
@@ -748,7 +1444,7 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
     if (p[0] != kMagic || p[1] != kVersion)
         return;
     uint8_t type = p[2];
-    bool isRetry = (p[3] & 0x01) != 0;
+    bool isRetry = (p[3] & kFlagRetry) != 0;
     uint16_t id = static_cast<uint16_t>(p[4]) | (static_cast<uint16_t>(p[5]) << 8);
 
     ESP_LOGV(TAG, "rx pkt type=%u len=%d id=%u retry=%d mac=%02X:%02X:%02X:%02X:%02X:%02X",
@@ -756,7 +1452,7 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
              mac ? mac[0] : 0, mac ? mac[1] : 0, mac ? mac[2] : 0,
              mac ? mac[3] : 0, mac ? mac[4] : 0, mac ? mac[5] : 0);
 
-    const bool needsAuth = (type == PacketType::DataBroadcast || type == PacketType::ControlJoinReq || type == PacketType::ControlJoinAck || type == PacketType::ControlAppAck || type == PacketType::ControlHeartbeat || type == PacketType::ControlLeave);
+    const bool needsAuth = packetNeedsAuth(type);
     if (needsAuth)
     {
         if (!instance_->verifyAuthTag(data, len, type))
@@ -778,7 +1474,7 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
     int payloadLen = len - static_cast<int>(cursor + (needsAuth ? kAuthTagLen : 0));
 
     int idx = (type == PacketType::ControlLeave) ? instance_->findPeerIndex(mac) : instance_->ensurePeer(mac);
-    if (type == PacketType::DataUnicast)
+    if (type == PacketType::DataUnicast || type == PacketType::DataUnicastBatch || type == PacketType::DataFragment)
     {
         if (idx >= 0)
         {
@@ -786,28 +1482,110 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
             instance_->peers_[idx].heartbeatStage = 0;
             instance_->peers_[idx].ready = true;
         }
-        bool duplicate = (idx >= 0 && instance_->peers_[idx].lastMsgId == id);
-        if (idx >= 0 && !duplicate)
-            instance_->peers_[idx].lastMsgId = id;
-        // Auto app-level ACK
-        if (instance_->config_.enableAppAck)
+        if (p[3] & kFlagAppAck)
         {
+            // piggybacked AppAck for our own frames, ahead of the application payload
+            if (payloadLen < static_cast<int>(sizeof(AppAckPayload)))
+                return;
             AppAckPayload ack{};
-            ack.msgId = id;
-            instance_->enqueueCommon(Dest::Unicast, PacketType::ControlAppAck, mac, &ack, sizeof(ack), kUseDefault);
+            memcpy(&ack, payload, sizeof(ack));
+            payload += sizeof(AppAckPayload);
+            payloadLen -= static_cast<int>(sizeof(AppAckPayload));
+            if (instance_->config_.useEncryption)
+                instance_->processAppAck(mac, idx, ack, true);
+        }
+        int fragSlot = -1;
+        if (type == PacketType::DataFragment)
+        {
+            // slots busy or malformed: stay silent (no AppAck) so the sender retries the fragment.
+            // A message we can never take is acked and dropped instead, so the sender's retries
+            // do not open its circuit to us
+            fragSlot = instance_->fragmentSlot(mac, payload, payloadLen);
+            if (fragSlot == kFragRejected)
+            {
+                if (idx >= 0 && !instance_->peers_[idx].fragRejectLogged)
+                {
+                    instance_->peers_[idx].fragRejectLogged = true;
+                    ESP_LOGW(TAG, "rx sendLarge() dropped (reassemblySlots=%u maxMessageBytes=%u) mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                             static_cast<unsigned>(instance_->config_.reassemblySlots), static_cast<unsigned>(instance_->config_.maxMessageBytes),
+                             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+                }
+            }
+            else if (fragSlot < 0)
+            {
+                return;
+            }
+        }
+        bool duplicate = false;
+        uint32_t fresh = 0; // container: bit n = record n is new
+        // the send task reads this window when it builds the AppAck bitmap
+        portENTER_CRITICAL(&instance_->txLock_);
+        if (type == PacketType::DataUnicastBatch)
+        {
+            // each record keeps its own msgId for duplicate detection; the sender keeps them within 32 ids
+            int off = 0;
+            for (size_t n = 0; n < kReplayWindow && off + static_cast<int>(kBatchRecordHeader) <= payloadLen; ++n)
+            {
+                const uint8_t *r = payload + off;
+                uint16_t recId = static_cast<uint16_t>(r[0]) | (static_cast<uint16_t>(r[1]) << 8);
+                int recLen = static_cast<int>(r[2]) | (static_cast<int>(r[3]) << 8);
+                off += static_cast<int>(kBatchRecordHeader) + recLen;
+                if (off > payloadLen)
+                    break;
+                if (idx < 0 || instance_->acceptUnicastMsgId(instance_->peers_[idx], recId))
+                    fresh |= 1UL << n;
+            }
+        }
+        else if (idx >= 0)
+        {
+            duplicate = !instance_->acceptUnicastMsgId(instance_->peers_[idx], id);
+        }
+        portEXIT_CRITICAL(&instance_->txLock_);
+        // Auto app-level ACK (held briefly when it can ride on our next frame to this peer)
+        if (instance_->config_.enableAppAck)
+        {
+            instance_->queueAppAck(idx, mac, id);
             if (instance_->onAppAck_)
             {
                 instance_->onAppAck_(mac, id);
             }
         }
+        if (type == PacketType::DataUnicastBatch)
+        {
+            // split the container back into one onReceive per message
+            int off = 0;
+            for (size_t n = 0; n < kReplayWindow && off + static_cast<int>(kBatchRecordHeader) <= payloadLen; ++n)
+            {
+                const uint8_t *r = payload + off;
+                int recLen = static_cast<int>(r[2]) | (static_cast<int>(r[3]) << 8);
+                off += static_cast<int>(kBatchRecordHeader) + recLen;
+                if (off > payloadLen)
+                {
+                    ESP_LOGW(TAG, "rx container truncated record=%u", static_cast<unsigned>(n));
+                    break;
+                }
+                if ((fresh & (1UL << n)) && instance_->onReceive_)
+                    instance_->onReceive_(mac, r + kBatchRecordHeader, static_cast<size_t>(recLen), isRetry, false);
+            }
+            return;
+        }
         if (duplicate)
         {
             ESP_LOGD(TAG, "rx unicast duplicate msgId=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
                      static_cast<unsigned>(id),
                      mac ? mac[0] : 0, mac ? mac[1] : 0, mac ? mac[2] : 0,
                      mac ? mac[3] : 0, mac ? mac[4] : 0, mac ? mac[5] : 0);
+            // a late copy of a fragment that already completed must not hold a fresh slot
+            if (fragSlot >= 0 && instance_->reassembly_[fragSlot].received == 0)
+                instance_->reassembly_[fragSlot].inUse = false;
             return; // duplicate payload is dropped
         }
+        if (type == PacketType::DataFragment)
+        {
+            if (fragSlot >= 0)
+                instance_->storeFragment(fragSlot, payload, payloadLen, isRetry);
+            return;
+        }
     }
     else if (type == PacketType::DataBroadcast)
     {
@@ -824,6 +1602,38 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
                      mac ? mac[3] : 0, mac ? mac[4] : 0, mac ? mac[5] : 0);
             return;
         }
+        if (p[3] & (kFlagReliable | kFlagFec))
+        {
+            // per-sender data sequence ahead of the payload; gaps in it are NACKed, FEC blocks are built on it
+            const int ext = (p[3] & kFlagFec) ? static_cast<int>(kFecDataExt) : 2;
+            if (payloadLen < ext || !mac)
+                return;
+            uint16_t dataSeq = static_cast<uint16_t>(payload[0]) | (static_cast<uint16_t>(payload[1]) << 8);
+            const uint8_t pos = payload[2];
+            payload += ext;
+            payloadLen -= ext;
+            // a repair goes out under a fresh seq, so the dataSeq decides whether this is news
+            if ((p[3] & kFlagReliable) && !instance_->trackBroadcastGap(mac, dataSeq))
+                return;
+            if ((p[3] & kFlagFec) && !instance_->absorbFecData(mac, dataSeq, pos, payload, payloadLen))
+                return; // already rebuilt from the parity
+        }
+    }
+    else if (type == PacketType::DataFecParity)
+    {
+        if (!mac || !instance_->acceptBroadcastSeq(mac, id))
+            return;
+        instance_->absorbFecParity(mac, payload, payloadLen);
+        return;
+    }
+    else if (type == PacketType::ControlNack)
+    {
+        if (payloadLen < static_cast<int>(sizeof(NackPayload)) || !mac || !instance_->acceptBroadcastSeq(mac, id))
+            return;
+        NackPayload nack{};
+        memcpy(&nack, payload, sizeof(nack));
+        instance_->processNack(mac, nack);
+        return;
     }
     else if (type == PacketType::ControlLeave)
     {
@@ -867,6 +1677,11 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
         {
             // resume path; nothing special
         }
+        else
+        {
+            // no token from our last handshake: the sender restarted, so its broadcast seq starts over too
+            instance_->forgetSender(mac);
+        }
         if (idx < 0)
             idx = instance_->ensurePeer(mac);
         JoinAckPayload ackPayload{};
@@ -878,7 +1693,7 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
             memcpy(instance_->peers_[idx].lastNonceB, ackPayload.nonceB, kNonceLen);
             instance_->peers_[idx].nonceValid = true;
         }
-        instance_->enqueueCommon(Dest::Broadcast, PacketType::ControlJoinAck, kBroadcastMac, &ackPayload, sizeof(ackPayload), kUseDefault);
+        instance_->enqueueCommon(Dest::Broadcast, PacketType::ControlJoinAck, kBroadcastMac, &ackPayload, sizeof(ackPayload), 0, Priority::Control);
         if (instance_->onJoinEvent_)
             instance_->onJoinEvent_(mac, true, false);
         return;
@@ -909,6 +1724,9 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
         {
             idx = instance_->ensurePeer(mac);
         }
+        // the echoed nonce proves this frame is fresh: take its seq as the sender's current broadcast seq
+        instance_->forgetSender(mac);
+        instance_->acceptBroadcastSeq(mac, id);
         if (idx >= 0)
         {
             memcpy(instance_->peers_[idx].lastNonceB, ack->nonceB, kNonceLen);
@@ -925,44 +1743,37 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
             instance_->onJoinEvent_(mac, true, true);
         return;
     }
-    else if (type == PacketType::ControlAppAck)
+    else if (type == PacketType::DataBulk || type == PacketType::ControlBulkAck)
     {
-        if (payloadLen < static_cast<int>(sizeof(AppAckPayload)))
-            return;
-        const AppAckPayload *ack = reinterpret_cast<const AppAckPayload *>(payload);
-        if (idx >= 0 && !instance_->acceptAppAck(instance_->peers_[idx], ack->msgId))
-        {
-            ESP_LOGW(TAG, "app-ack replay drop msgId=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
-                     ack->msgId,
-                     mac ? mac[0] : 0, mac ? mac[1] : 0, mac ? mac[2] : 0,
-                     mac ? mac[3] : 0, mac ? mac[4] : 0, mac ? mac[5] : 0);
-            return;
-        }
         if (idx >= 0)
         {
             instance_->peers_[idx].lastSeenMs = millis();
             instance_->peers_[idx].heartbeatStage = 0;
             instance_->peers_[idx].ready = true;
         }
-        if (instance_->txInFlight_ && instance_->currentTx_.expectAck && ack->msgId == instance_->currentTx_.msgId)
-        {
-            if (instance_->onSendResult_)
-                instance_->onSendResult_(mac, SendStatus::AppAckReceived);
-            instance_->recordSendSuccess(mac);
-            instance_->freeBuffer(instance_->currentTx_.bufferIndex);
-            instance_->txInFlight_ = false;
-            instance_->retryCount_ = 0;
-        }
-        else if (!instance_->txInFlight_)
+        if (type == PacketType::DataBulk)
         {
-            ESP_LOGW(TAG, "app-ack late or no in-flight msgId=%u", ack->msgId);
+            instance_->receiveBulk(mac, payload, payloadLen);
         }
-        if (instance_->onAppAck_)
+        else if (payloadLen >= static_cast<int>(sizeof(BulkAckPayload)))
         {
-            instance_->onAppAck_(mac, ack->msgId);
+            BulkAckPayload ack{};
+            memcpy(&ack, payload, sizeof(ack));
+            instance_->processBulkAck(mac, ack);
         }
         return;
     }
+    else if (type == PacketType::ControlAppAck)
+    {
+        if (payloadLen < static_cast<int>(kAppAckLegacyLen))
+            return;
+        // 6 bytes = newest msgId + received bitmap; 2 bytes = single msgId from older firmware
+        AppAckPayload ack{};
+        const bool cumulative = payloadLen >= static_cast<int>(sizeof(AppAckPayload));
+        memcpy(&ack, payload, cumulative ? sizeof(AppAckPayload) : kAppAckLegacyLen);
+        instance_->processAppAck(mac, idx, ack, cumulative);
+        return;
+    }
     else if (type == PacketType::ControlHeartbeat)
     {
         if (payloadLen < static_cast<int>(sizeof(HeartbeatPayload)))
@@ -978,7 +1789,7 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
         {
             // Ping -> respond Pong
             HeartbeatPayload pong{1};
-            instance_->enqueueCommon(Dest::Unicast, PacketType::ControlHeartbeat, mac, &pong, sizeof(pong), kUseDefault);
+            instance_->enqueueCommon(Dest::Unicast, PacketType::ControlHeartbeat, mac, &pong, sizeof(pong), 0, Priority::Control);
         }
         return;
     }
@@ -997,240 +1808,2321 @@ void EspNowBus::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len
     }
 }
 
-void EspNowBus::sendTaskTrampoline(void *arg)
-{
-    auto *self = static_cast<EspNowBus *>(arg);
-    self->selfTaskHandle_ = xTaskGetCurrentTaskHandle();
-    self->sendTaskLoop();
-}
-
-bool EspNowBus::startSend(const TxItem &item)
+int EspNowBus::fragmentSlot(const uint8_t mac[6], const uint8_t *payload, int len)
 {
-    uint8_t *buf = bufferPtr(item.bufferIndex);
-    if (!buf)
-        return false;
-    // update header flags/msgId for retry
-    if (item.isRetry)
+    if (!mac || len < static_cast<int>(sizeof(FragmentHeader)))
+        return -1;
+    FragmentHeader fh{};
+    memcpy(&fh, payload, sizeof(fh));
+    const size_t chunk = static_cast<size_t>(len) - sizeof(fh);
+    if (!reassemblyPool_ || fh.totalLen > config_.maxMessageBytes)
+        return kFragRejected;
+    if (fh.fragSize == 0 || fh.offset % fh.fragSize != 0 ||
+        (fh.offset >= fh.totalLen && !(fh.offset == 0 && fh.totalLen == 0)))
+        return -1;
+    const uint32_t count = (fh.totalLen == 0) ? 1 : (fh.totalLen + fh.fragSize - 1) / fh.fragSize;
+    const uint32_t expect = (fh.totalLen - fh.offset < fh.fragSize) ? fh.totalLen - fh.offset : fh.fragSize;
+    if (count > kMaxFragments || chunk != expect)
     {
-        buf[3] |= 0x01; // isRetry flag
+        ESP_LOGW(TAG, "rx fragment malformed mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return -1;
     }
-    // Recompute auth tag if needed (flags change alters HMAC input)
-    if (item.pktType == PacketType::DataBroadcast ||
-        item.pktType == PacketType::ControlJoinReq ||
-        item.pktType == PacketType::ControlJoinAck ||
-        item.pktType == PacketType::ControlAppAck ||
-        item.pktType == PacketType::ControlHeartbeat ||
-        item.pktType == PacketType::ControlLeave)
+    const uint32_t nowMs = millis();
+    int victim = -1;
+    for (size_t i = 0; i < config_.reassemblySlots; ++i)
     {
-        const uint8_t *key = (item.pktType == PacketType::ControlJoinReq ||
-                              item.pktType == PacketType::ControlJoinAck ||
-                              item.pktType == PacketType::ControlAppAck ||
-                              item.pktType == PacketType::ControlHeartbeat)
-                                 ? derived_.keyAuth
-                                 : derived_.keyBcast;
-        if (item.len >= kHeaderSize + 4 + kAuthTagLen)
+        Reassembly &r = reassembly_[i];
+        const bool stale = r.inUse && nowMs - r.lastMs >= config_.reassemblyTimeoutMs;
+        if (r.inUse && !stale && r.messageId == fh.messageId && r.totalLen == fh.totalLen &&
+            r.fragSize == fh.fragSize && memcmp(r.mac, mac, 6) == 0)
+            return static_cast<int>(i);
+        // free first, then delivered or abandoned slots, oldest first
+        if (!r.inUse)
         {
-            size_t tagOffset = static_cast<size_t>(item.len) - kAuthTagLen;
-            computeAuthTag(buf + tagOffset, buf, tagOffset, key);
+            if (victim < 0 || reassembly_[victim].inUse)
+                victim = static_cast<int>(i);
+        }
+        else if ((r.complete || stale) && (victim < 0 || (reassembly_[victim].inUse && static_cast<int32_t>(r.lastMs - reassembly_[victim].lastMs) < 0)))
+        {
+            victim = static_cast<int>(i);
         }
     }
-    const uint8_t *targetMac = item.mac;
-    esp_err_t err = esp_now_send(targetMac, buf, item.len);
-    if (err != ESP_OK)
+    if (victim < 0)
     {
-        ESP_LOGE(TAG, "esp_now_send failed err=%d mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u",
-                 static_cast<int>(err),
-                 targetMac[0], targetMac[1], targetMac[2], targetMac[3], targetMac[4], targetMac[5],
-                 static_cast<unsigned>(item.len));
-        return false;
+        ESP_LOGD(TAG, "rx fragment: no reassembly slot mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return -1;
     }
-    return true;
+    Reassembly &r = reassembly_[victim];
+    uint8_t *data = r.data;
+    r = Reassembly{};
+    r.data = data;
+    r.inUse = true;
+    memcpy(r.mac, mac, 6);
+    r.messageId = fh.messageId;
+    r.fragSize = fh.fragSize;
+    r.fragCount = static_cast<uint16_t>(count);
+    r.totalLen = fh.totalLen;
+    r.lastMs = nowMs;
+    return victim;
 }
 
-void EspNowBus::handleSendComplete(bool ok, bool timedOut)
+void EspNowBus::storeFragment(int slot, const uint8_t *payload, int len, bool isRetry)
 {
-    if (!txInFlight_)
+    Reassembly &r = reassembly_[slot];
+    FragmentHeader fh{};
+    memcpy(&fh, payload, sizeof(fh));
+    const uint32_t index = fh.offset / r.fragSize;
+    if (r.complete || (r.have[index / 32] & (1UL << (index % 32))))
+        return; // already have it (the AppAck for it was lost)
+    memcpy(r.data + fh.offset, payload + sizeof(fh), static_cast<size_t>(len) - sizeof(fh));
+    r.have[index / 32] |= 1UL << (index % 32);
+    r.lastMs = millis();
+    if (++r.received < r.fragCount)
         return;
-    auto entry = currentTx_;
-    if (ok)
+    r.complete = true;
+    ESP_LOGD(TAG, "rx message complete id=%u len=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             static_cast<unsigned>(r.messageId), static_cast<unsigned>(r.totalLen),
+             r.mac[0], r.mac[1], r.mac[2], r.mac[3], r.mac[4], r.mac[5]);
+    if (onReceive_)
+        onReceive_(r.mac, r.data, r.totalLen, isRetry, false);
+}
+
+uint16_t EspNowBus::bulkChunkSize() const
+{
+    return static_cast<uint16_t>(frameLimit() - frameHeaderLen(PacketType::DataBulk) - sizeof(BulkHeader));
+}
+
+void EspNowBus::serviceBulk(uint32_t nowMs)
+{
+    BulkTx &tx = bulkTx_;
+    if (!tx.active)
+        return;
+    int idx = findPeerIndex(tx.mac);
+    const bool reachable = idx >= 0 && peers_[idx].ready && !peers_[idx].circuitOpen;
+    // budget for one ack round trip plus the chunks queued ahead of the poked one, doubled per silent timeout
+    uint32_t rtoMs = peerRtoMs(tx.mac) + (kBulkQueueDepth * frameAirtimeUs(frameLimit()) + 999) / 1000;
+    for (uint8_t i = 0; i < tx.timeouts && rtoMs < config_.rtoMaxMs; ++i)
+        rtoMs <<= 1;
+
+    bool report = false;
+    BulkEvent event = BulkEvent::Progress;
+    portENTER_CRITICAL(&txLock_);
+    tx.rtoMs = rtoMs;
+    if (tx.base >= tx.chunkCount)
     {
-        if (entry.expectAck)
-        {
-            // Physical success; wait for app-ack to finalize
-            txDeadlineMs_ = millis() + config_.txTimeoutMs;
-            return;
-        }
-        if (onSendResult_)
-            onSendResult_(entry.mac, SendStatus::SentOk);
-        recordSendSuccess(entry.mac);
-        freeBuffer(entry.bufferIndex);
-        txInFlight_ = false;
-        retryCount_ = 0;
+        event = BulkEvent::Completed;
     }
-    else
+    else if (static_cast<int32_t>(nowMs - tx.progressMs) >= static_cast<int32_t>(config_.bulkIdleTimeoutMs))
+    {
+        event = BulkEvent::Failed;
+    }
+    else if (!reachable)
+    {
+        report = !tx.paused;
+        tx.paused = true;
+        event = BulkEvent::Paused;
+    }
+    else if (tx.paused)
     {
-        if (retryCount_ < config_.maxRetries)
+        // the receiver kept its state; one poll tells us where it stands
+        tx.paused = false;
+        tx.resend |= (tx.next > tx.base) ? 1u : 0u;
+        tx.retxd = 0;
+        report = true;
+        event = BulkEvent::Resumed;
+    }
+    else if (tx.progressed)
+    {
+        tx.progressed = false;
+        report = true;
+    }
+    if (!tx.paused && tx.next > tx.base && !tx.resend && static_cast<int32_t>(nowMs - tx.deadlineMs) >= 0)
+    {
+        // nothing heard for an RTO: poll the oldest chunk, the answer carries the receiver's full window
+        tx.resend |= 1u;
+        tx.retxd = 0;
+        if (tx.timeouts < 8)
+            tx.timeouts++;
+    }
+    const uint32_t done = (tx.base * tx.chunkSize < tx.totalLen) ? tx.base * tx.chunkSize : tx.totalLen;
+    portEXIT_CRITICAL(&txLock_);
+    if (event == BulkEvent::Completed || event == BulkEvent::Failed)
+    {
+        finishBulk(event);
+        return;
+    }
+    if (report && onBulkProgress_)
+        onBulkProgress_(tx.mac, event, done, tx.totalLen);
+
+    while (!tx.paused && sendQueueSize(tx.mac) < kBulkQueueDepth)
+    {
+        uint32_t index = 0;
+        bool poll = true;
+        bool retry = false;
+        BulkTx snap{};
+        portENTER_CRITICAL(&txLock_);
+        if (!tx.active)
         {
-            retryCount_++;
-            currentTx_.isRetry = true;
-            if (config_.retryDelayMs > 0)
-            {
-                vTaskDelay(pdMS_TO_TICKS(config_.retryDelayMs));
-            }
-            startSend(currentTx_);
-            txDeadlineMs_ = millis() + config_.txTimeoutMs;
-            if (onSendResult_)
-                onSendResult_(entry.mac, SendStatus::Retrying);
+            portEXIT_CRITICAL(&txLock_);
             return;
         }
-        if (onSendResult_)
-            onSendResult_(entry.mac, timedOut ? SendStatus::Timeout : SendStatus::SendFailed);
-        if (timedOut)
+        if (tx.resend)
+        {
+            uint32_t n = static_cast<uint32_t>(__builtin_ctz(tx.resend));
+            tx.resend &= ~(1u << n);
+            tx.retxd |= 1u << n;
+            index = tx.base + n;
+            retry = true;
+        }
+        else if (tx.next < tx.chunkCount && tx.next - tx.base < config_.bulkWindow)
         {
-            ESP_LOGW(TAG, "send timeout mac=%02X:%02X:%02X:%02X:%02X:%02X", entry.mac[0], entry.mac[1], entry.mac[2], entry.mac[3], entry.mac[4], entry.mac[5]);
+            index = tx.next++;
+            // ask for an ack whenever the window (or the transfer) runs out
+            poll = tx.next == tx.chunkCount || tx.next - tx.base == config_.bulkWindow;
         }
         else
         {
-            ESP_LOGE(TAG, "send failed mac=%02X:%02X:%02X:%02X:%02X:%02X", entry.mac[0], entry.mac[1], entry.mac[2], entry.mac[3], entry.mac[4], entry.mac[5]);
+            portEXIT_CRITICAL(&txLock_);
+            break;
         }
-        recordSendFailure(entry.mac);
-        freeBuffer(entry.bufferIndex);
-        txInFlight_ = false;
-        retryCount_ = 0;
+        tx.deadlineMs = nowMs + rtoMs;
+        snap = tx;
+        portEXIT_CRITICAL(&txLock_);
+        if (sendBulkChunk(snap, index, poll))
+            continue;
+        if (!tx.active)
+            return;
+        // no buffer or lane space right now; put the chunk back and try on the next pass
+        portENTER_CRITICAL(&txLock_);
+        if (retry && index >= tx.base && index - tx.base < 32)
+            tx.resend |= 1u << (index - tx.base);
+        else if (!retry && tx.next == index + 1)
+            tx.next = index;
+        portEXIT_CRITICAL(&txLock_);
+        break;
     }
+
+    uint32_t due = tx.progressMs + config_.bulkIdleTimeoutMs;
+    if (!tx.paused && tx.next > tx.base && static_cast<int32_t>(tx.deadlineMs - due) < 0)
+        due = tx.deadlineMs;
+    armTimer(kTimerBulk, due);
 }
 
-bool EspNowBus::sendNextIfIdle(TickType_t waitTicks)
+bool EspNowBus::sendBulkChunk(const BulkTx &tx, uint32_t index, bool poll)
 {
-    if (txInFlight_)
-        return true;
-    TxItem item{};
-    if (xQueueReceive(sendQueue_, &item, waitTicks) == pdTRUE)
+    const uint32_t offset = index * tx.chunkSize;
+    const size_t len = (tx.totalLen - offset < tx.chunkSize) ? tx.totalLen - offset : tx.chunkSize;
+    SendStatus failed = SendStatus::Queued;
+    int16_t bufIdx = acquireBuffer(PacketType::DataBulk, tx.mac, sizeof(BulkHeader) + len, 0, &failed);
+    if (bufIdx < 0)
+        return false;
+    uint8_t *dst = bufferPtr(static_cast<uint16_t>(bufIdx)) + frameHeaderLen(PacketType::DataBulk);
+    BulkHeader bh{};
+    bh.transferId = tx.transferId;
+    bh.totalLen = tx.totalLen;
+    bh.index = index;
+    bh.chunkSize = tx.chunkSize;
+    bh.flags = poll ? kBulkPoll : 0;
+    memcpy(dst, &bh, sizeof(bh));
+    if (tx.source(offset, dst + sizeof(bh), len) != len)
     {
-        currentTx_ = item;
-        retryCount_ = 0;
-        txInFlight_ = startSend(item);
-        txDeadlineMs_ = millis() + config_.txTimeoutMs;
-        if (!txInFlight_)
-        {
-            freeBuffer(item.bufferIndex);
-            if (onSendResult_)
-                onSendResult_(item.mac, SendStatus::SendFailed);
-            ESP_LOGE(TAG, "startSend failed mac=%02X:%02X:%02X:%02X:%02X:%02X",
-                     item.mac[0], item.mac[1], item.mac[2], item.mac[3], item.mac[4], item.mac[5]);
-        }
-        return true;
+        freeBuffer(static_cast<uint16_t>(bufIdx));
+        ESP_LOGE(TAG, "bulk source returned short at offset=%u", static_cast<unsigned>(offset));
+        finishBulk(BulkEvent::Failed);
+        return false;
     }
-    return false;
+    SendOptions opts;
+    opts.timeoutMs = 0;
+    opts.priority = Priority::Bulk;
+    return finalizeAndQueue(Dest::Unicast, PacketType::DataBulk, tx.mac, static_cast<uint16_t>(bufIdx), sizeof(bh) + len, opts);
 }
 
-void EspNowBus::sendTaskLoop()
+void EspNowBus::finishBulk(BulkEvent event)
 {
-    while (true)
+    BulkTx &tx = bulkTx_;
+    portENTER_CRITICAL(&txLock_);
+    const bool wasActive = tx.active;
+    tx.active = false;
+    const uint32_t done = (event == BulkEvent::Completed) ? tx.totalLen
+                          : (tx.base * tx.chunkSize < tx.totalLen) ? tx.base * tx.chunkSize
+                                                                   : tx.totalLen;
+    wheelUnlink(kTimerBulk);
+    portEXIT_CRITICAL(&txLock_);
+    if (!wasActive)
+        return;
+    ESP_LOGI(TAG, "bulk end id=%08X event=%u done=%u/%u", static_cast<unsigned>(tx.transferId),
+             static_cast<unsigned>(event), static_cast<unsigned>(done), static_cast<unsigned>(tx.totalLen));
+    if (onBulkProgress_)
+        onBulkProgress_(tx.mac, event, done, tx.totalLen);
+}
+
+void EspNowBus::processBulkAck(const uint8_t mac[6], const BulkAckPayload &ack)
+{
+    BulkTx &tx = bulkTx_;
+    const uint32_t nowMs = millis();
+    bool moved = false;
+    portENTER_CRITICAL(&txLock_);
+    if (tx.active && tx.transferId == ack.transferId && memcmp(tx.mac, mac, 6) == 0)
     {
-        uint32_t nowMs = millis();
-        reseedCounters(nowMs);
-        // Auto JOIN scheduler
-        if (config_.autoJoinIntervalMs > 0 && (nowMs - lastAutoJoinMs_) >= config_.autoJoinIntervalMs)
+        if ((ack.flags & kBulkAckReset) && tx.base == 0)
         {
-            lastAutoJoinMs_ = nowMs;
-            sendJoinRequest();
+            // chunk 0 has not arrived yet, so the receiver did not know the session: repeat chunk 0 once
+            if (!(tx.retxd & 1u))
+                tx.resend |= 1u;
         }
-        // Heartbeat / liveness maintenance
-        for (size_t i = 0; i < kMaxPeers; ++i)
+        else if (ack.flags & kBulkAckReset)
         {
-            auto &p = peers_[i];
-            if (!p.inUse)
-                continue;
-            if (p.lastSeenMs == 0)
-                p.lastSeenMs = nowMs;
-            uint32_t elapsed = nowMs - p.lastSeenMs;
-            uint32_t hb = config_.heartbeatIntervalMs;
-            if (hb == 0)
-                continue;
-            if (elapsed >= hb * 3)
-            {
-                ESP_LOGW(TAG, "peer timeout drop mac=%02X:%02X:%02X:%02X:%02X:%02X",
-                         p.mac[0], p.mac[1], p.mac[2], p.mac[3], p.mac[4], p.mac[5]);
-                if (onJoinEvent_)
-                    onJoinEvent_(p.mac, false, false); // treat as leave/timeout
-                removePeer(p.mac);
-                p.inUse = false;
-                p.ready = false;
-                continue;
-            }
-            if (elapsed >= hb * 2)
+            // the receiver lost the session (restart or replaced): everything goes again from chunk 0
+            tx.base = 0;
+            tx.next = 0;
+            tx.acked = tx.resend = tx.retxd = 0;
+            tx.progressed = true;
+            moved = true;
+        }
+        else if (ack.base >= tx.base && ack.base <= tx.next)
+        {
+            const uint32_t shift = ack.base - tx.base;
+            if (shift > 0)
             {
-                if (p.heartbeatStage < 2)
-                {
-                    sendJoinRequest(p.mac);
-                    p.heartbeatStage = 2;
-                }
-                continue;
+                tx.acked = (shift >= 32) ? 0 : tx.acked >> shift;
+                tx.resend = (shift >= 32) ? 0 : tx.resend >> shift;
+                tx.retxd = (shift >= 32) ? 0 : tx.retxd >> shift;
+                tx.base = ack.base;
+                tx.progressed = true;
+                moved = true;
             }
-            if (elapsed >= hb)
+            const uint32_t sent = tx.next - tx.base;
+            tx.acked = (tx.acked | (ack.bits << 1)) & ((sent >= 32) ? ~0u : (1u << sent) - 1);
+            tx.resend &= ~tx.acked;
+            if (tx.acked)
             {
-                if (p.heartbeatStage < 1)
-                {
-                    HeartbeatPayload ping{0};
-                    enqueueCommon(Dest::Unicast, PacketType::ControlHeartbeat, p.mac, &ping, sizeof(ping), kUseDefault);
-                    p.heartbeatStage = 1;
-                }
+                // selective repeat: a gap below the newest chunk the receiver holds was lost; resend it once per timeout
+                const uint32_t top = 31u - static_cast<uint32_t>(__builtin_clz(tx.acked));
+                tx.resend |= ((1u << top) - 1) & ~tx.acked & ~tx.retxd;
             }
         }
-        if (!txInFlight_)
+        if (moved)
         {
-            sendNextIfIdle(pdMS_TO_TICKS(100));
-            continue;
+            tx.progressMs = nowMs;
+            tx.timeouts = 0;
         }
-        uint32_t deadline = txDeadlineMs_;
-        TickType_t waitTicks = (deadline > nowMs) ? pdMS_TO_TICKS(deadline - nowMs) : 0;
-        uint32_t notifyVal = 0;
-        BaseType_t notified = xTaskNotifyWait(0, 0xFFFFFFFF, &notifyVal, waitTicks);
-        if (notified == pdTRUE)
+        tx.deadlineMs = nowMs + tx.rtoMs; // the link is alive; a tail still missing after this gets polled
+    }
+    portEXIT_CRITICAL(&txLock_);
+    wakeSendTask();
+}
+
+void EspNowBus::receiveBulk(const uint8_t mac[6], const uint8_t *payload, int len)
+{
+    if (!bulkRxPool_ || !mac || len < static_cast<int>(sizeof(BulkHeader)))
+        return;
+    BulkHeader bh{};
+    memcpy(&bh, payload, sizeof(bh));
+    const uint8_t *bytes = payload + sizeof(bh);
+    const size_t n = static_cast<size_t>(len) - sizeof(bh);
+    const uint32_t count = (bh.chunkSize == 0) ? 0 : bh.totalLen / bh.chunkSize + (bh.totalLen % bh.chunkSize ? 1 : 0);
+    if (bh.chunkSize == 0 || bh.chunkSize > bulkChunkSize() || bh.index >= count ||
+        n != ((bh.totalLen - bh.index * bh.chunkSize < bh.chunkSize) ? bh.totalLen - bh.index * bh.chunkSize : bh.chunkSize))
+    {
+        ESP_LOGW(TAG, "rx bulk chunk malformed mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return;
+    }
+    BulkRx &rx = bulkRx_;
+    const uint32_t nowMs = millis();
+    if (!rx.active || rx.transferId != bh.transferId || memcmp(rx.mac, mac, 6) != 0)
+    {
+        // one inbound session at a time; another sender keeps retrying until this one ends or goes idle.
+        // A new session from the same sender replaces its old one (it only runs one at a time).
+        if (rx.active && !rx.complete && memcmp(rx.mac, mac, 6) != 0 && nowMs - rx.lastMs < config_.bulkIdleTimeoutMs)
+            return;
+        if (bh.index != 0)
         {
-            bool ok = notifyVal == 1;
-            handleSendComplete(ok, false);
-            continue;
+            sendBulkAck(mac, bh.transferId, kBulkAckReset);
+            return;
         }
-        // timeout
-        if (millis() >= txDeadlineMs_)
+        rx = BulkRx{};
+        rx.active = true;
+        memcpy(rx.mac, mac, 6);
+        rx.transferId = bh.transferId;
+        rx.totalLen = bh.totalLen;
+        rx.chunkSize = bh.chunkSize;
+        rx.chunkCount = count;
+        ESP_LOGI(TAG, "rx bulk start id=%08X len=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 static_cast<unsigned>(bh.transferId), static_cast<unsigned>(bh.totalLen),
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+    rx.lastMs = nowMs;
+    bool ackNow = (bh.flags & kBulkPoll) != 0;
+    const uint32_t ahead = bh.index - rx.base;
+    if (bh.index < rx.base || ahead >= config_.bulkWindow)
+    {
+        ackNow = true; // repeat (our ack was lost) or beyond our window
+    }
+    else if (ahead == 0)
+    {
+        auto deliver = [&](uint32_t index, const uint8_t *data)
         {
-            handleSendComplete(false, true);
+            const uint32_t offset = index * rx.chunkSize;
+            const size_t chunk = (rx.totalLen - offset < rx.chunkSize) ? rx.totalLen - offset : rx.chunkSize;
+            if (onBulkReceive_)
+                onBulkReceive_(mac, offset, data, chunk, rx.totalLen);
+        };
+        deliver(rx.base++, bytes);
+        ++rx.sinceAck;
+        // drain chunks that were waiting behind the gap
+        while (rx.have & 1u)
+        {
+            rx.have >>= 1;
+            deliver(rx.base, bulkRxPool_ + static_cast<size_t>(rx.base % config_.bulkWindow) * rx.chunkSize);
+            ++rx.base;
+            ++rx.sinceAck;
         }
-
-        // app-ack timeout check
-        if (txInFlight_ && currentTx_.expectAck)
+        rx.have >>= 1;
+        rx.gapAcked = false;
+        if (rx.base >= rx.chunkCount)
         {
-            uint32_t now2 = millis();
-            if (now2 >= currentTx_.appAckDeadlineMs)
-            {
-                if (retryCount_ < config_.maxRetries)
-                {
-                    retryCount_++;
-                    currentTx_.isRetry = true;
-                    startSend(currentTx_);
-                    currentTx_.appAckDeadlineMs = millis() + config_.txTimeoutMs;
-                    if (onSendResult_)
-                        onSendResult_(currentTx_.mac, SendStatus::Retrying);
-                }
-                else
-                {
-                    if (onSendResult_)
-                        onSendResult_(currentTx_.mac, SendStatus::AppAckTimeout);
-                    ESP_LOGW(TAG, "app-ack timeout mac=%02X:%02X:%02X:%02X:%02X:%02X", currentTx_.mac[0], currentTx_.mac[1], currentTx_.mac[2], currentTx_.mac[3], currentTx_.mac[4], currentTx_.mac[5]);
-                    recordSendFailure(currentTx_.mac);
-                    freeBuffer(currentTx_.bufferIndex);
-                    txInFlight_ = false;
-                    retryCount_ = 0;
-                }
-            }
+            rx.complete = true;
+            ackNow = true;
+            ESP_LOGI(TAG, "rx bulk complete id=%08X", static_cast<unsigned>(rx.transferId));
         }
     }
-}
-
-bool EspNowBus::deriveKeys(const char *groupName)
-{
+    else if (rx.have & (1u << (ahead - 1)))
+    {
+        ackNow = true;
+    }
+    else
+    {
+        memcpy(bulkRxPool_ + static_cast<size_t>(bh.index % config_.bulkWindow) * rx.chunkSize, bytes, n);
+        rx.have |= 1u << (ahead - 1);
+        // report a new gap once so the sender repeats it without waiting for its timeout
+        ackNow = ackNow || !rx.gapAcked;
+        rx.gapAcked = true;
+    }
+    const uint8_t ackEvery = (config_.bulkWindow >= 8) ? config_.bulkWindow / 4 : 1;
+    if (ackNow || rx.sinceAck >= ackEvery)
+        sendBulkAck(mac, bh.transferId, 0);
+}
+
+void EspNowBus::sendBulkAck(const uint8_t mac[6], uint32_t transferId, uint8_t flags)
+{
+    BulkAckPayload ack{};
+    ack.transferId = transferId;
+    ack.flags = flags;
+    if (!(flags & kBulkAckReset))
+    {
+        ack.base = bulkRx_.base;
+        ack.bits = bulkRx_.have;
+        bulkRx_.sinceAck = 0;
+    }
+    enqueueCommon(Dest::Unicast, PacketType::ControlBulkAck, mac, &ack, sizeof(ack), 0, Priority::Control);
+}
+
+void EspNowBus::recordBroadcast(TxItem &item, uint8_t *buf)
+{
+    // numbered on first transmission, so frames replaced or expired in the queue leave no gap
+    const uint16_t dataSeq = ++bcastDataSeq_;
+    buf[kHeaderSize + 4] = static_cast<uint8_t>(dataSeq & 0xFF);
+    buf[kHeaderSize + 5] = static_cast<uint8_t>((dataSeq >> 8) & 0xFF);
+    if (buf[3] & kFlagFec)
+        addFecMember(item, buf, dataSeq);
+    if (config_.broadcastHistory == 0)
+        return;
+    portENTER_CRITICAL(&txLock_);
+    BcastHistory &h = bcastHistory_[dataSeq % config_.broadcastHistory];
+    const bool evict = h.valid;
+    const uint16_t old = h.bufferIndex;
+    h.valid = true;
+    h.dataSeq = dataSeq;
+    h.bufferIndex = item.bufferIndex;
+    h.len = item.len;
+    h.repaired = false;
+    bufferRefs_[item.bufferIndex].fetch_add(1, std::memory_order_acq_rel);
+    portEXIT_CRITICAL(&txLock_);
+    if (evict)
+        freeBuffer(old);
+}
+
+void EspNowBus::addFecMember(const TxItem &item, uint8_t *buf, uint16_t dataSeq)
+{
+    // called as the frame goes on air, so block members are consecutive dataSeqs in send order
+    const size_t off = kHeaderSize + 4 + kFecDataExt;
+    const size_t len = item.len - off - kAuthTagLen;
+    const size_t parityOff = frameHeaderLen(PacketType::DataFecParity) + sizeof(FecParityHeader);
+    if (fecTxCount_ == 0)
+    {
+        // the parity accumulates in place in a pool buffer taken now (begin() adds one for it), so
+        // flushing never waits for a buffer behind a backed-up broadcast lane
+        const size_t room = frameLimit() - frameHeaderLen(PacketType::DataFecParity) - kAuthTagLen;
+        SendStatus failed = SendStatus::DroppedFull;
+        fecTxBufIdx_ = acquireBuffer(PacketType::DataFecParity, kBroadcastMac, room, 0, &failed);
+        if (fecTxBufIdx_ >= 0)
+            memset(bufferPtr(static_cast<uint16_t>(fecTxBufIdx_)) + parityOff, 0, room - sizeof(FecParityHeader));
+        fecTxFirst_ = dataSeq;
+        fecTxLenXor_ = 0;
+        fecTxSpan_ = 0;
+        armTimer(kTimerFec, millis() + kFecFlushMs);
+    }
+    buf[kHeaderSize + 6] = fecTxCount_;
+    if (fecTxBufIdx_ >= 0)
+    {
+        uint8_t *parity = bufferPtr(static_cast<uint16_t>(fecTxBufIdx_)) + parityOff;
+        for (size_t i = 0; i < len; ++i)
+            parity[i] ^= buf[off + i];
+    }
+    fecTxLenXor_ ^= static_cast<uint16_t>(len);
+    if (len > fecTxSpan_)
+        fecTxSpan_ = static_cast<uint16_t>(len);
+    if (++fecTxCount_ >= config_.fecBlockSize)
+        flushFecParity();
+}
+
+void EspNowBus::flushFecParity()
+{
+    if (fecTxCount_ == 0)
+        return;
+    cancelTimer(kTimerFec);
+    FecParityHeader h{};
+    h.first = fecTxFirst_;
+    h.count = fecTxCount_;
+    h.lenXor = fecTxLenXor_;
+    fecTxCount_ = 0;
+    const int16_t bufIdx = fecTxBufIdx_;
+    fecTxBufIdx_ = -1;
+    if (bufIdx < 0)
+    {
+        ESP_LOGW(TAG, "fec block unprotected (no buffer) first=%u", static_cast<unsigned>(h.first));
+        return;
+    }
+    memcpy(bufferPtr(static_cast<uint16_t>(bufIdx)) + frameHeaderLen(PacketType::DataFecParity), &h, sizeof(h));
+    // pushTx() puts the parity at the head of the broadcast lane: receivers decode one block per sender,
+    // so it must go on air before the next block's frames that are already queued
+    SendOptions opts;
+    opts.timeoutMs = 0;
+    opts.priority = Priority::Control;
+    if (!finalizeAndQueue(Dest::Broadcast, PacketType::DataFecParity, kBroadcastMac, static_cast<uint16_t>(bufIdx), sizeof(h) + fecTxSpan_, opts))
+        ESP_LOGW(TAG, "fec parity dropped first=%u", static_cast<unsigned>(h.first));
+}
+
+EspNowBus::FecRx *EspNowBus::fecBlock(const uint8_t mac[6], uint16_t first)
+{
+    const uint32_t nowMs = millis();
+    FecRx *victim = nullptr;
+    for (auto &b : fecRx_)
+    {
+        if (b.inUse && memcmp(b.mac, mac, 6) == 0)
+        {
+            // late frame of an earlier block (e.g. a NACK repair): deliver it, nothing to decode. The sender
+            // queues each parity ahead of the next block, so only a reordered parity ends up here
+            if (b.first != first && static_cast<int16_t>(first - b.first) < 0)
+                return nullptr;
+            victim = &b;
+            break;
+        }
+        if (!victim || (victim->inUse && (!b.inUse || static_cast<int32_t>(b.lastMs - victim->lastMs) < 0)))
+            victim = &b;
+    }
+    if (!victim || !victim->acc)
+        return nullptr;
+    if (!victim->inUse || memcmp(victim->mac, mac, 6) != 0 || victim->first != first)
+    {
+        // a newer block (or another sender) takes the slot; what was missing in the old one stays lost
+        memset(victim->acc, 0, victim->span);
+        uint8_t *acc = victim->acc;
+        *victim = FecRx{};
+        victim->acc = acc;
+        victim->inUse = true;
+        memcpy(victim->mac, mac, 6);
+        victim->first = first;
+    }
+    victim->lastMs = nowMs;
+    return victim;
+}
+
+bool EspNowBus::absorbFecData(const uint8_t mac[6], uint16_t dataSeq, uint8_t pos, const uint8_t *data, int len)
+{
+    if (!fecPool_ || pos >= kMaxFecBlock || len < 0)
+        return true;
+    FecRx *b = fecBlock(mac, static_cast<uint16_t>(dataSeq - pos));
+    if (!b)
+        return true;
+    const uint16_t bit = static_cast<uint16_t>(1u << pos);
+    if (b->have & bit)
+        return false;
+    b->have |= bit;
+    if (b->done)
+        return true;
+    for (int i = 0; i < len; ++i)
+        b->acc[i] ^= data[i];
+    b->lenXor ^= static_cast<uint16_t>(len);
+    if (len > b->span)
+        b->span = static_cast<uint16_t>(len);
+    rebuildFecFrame(*b);
+    return true;
+}
+
+void EspNowBus::absorbFecParity(const uint8_t mac[6], const uint8_t *payload, int len)
+{
+    if (!fecPool_ || len < static_cast<int>(sizeof(FecParityHeader)))
+        return;
+    FecParityHeader h{};
+    memcpy(&h, payload, sizeof(h));
+    const int span = len - static_cast<int>(sizeof(h));
+    if (h.count == 0 || h.count > kMaxFecBlock || span > static_cast<int>(frameLimit()))
+        return;
+    FecRx *b = fecBlock(mac, h.first);
+    if (!b || b->parity || b->done)
+        return;
+    b->parity = true;
+    b->count = h.count;
+    for (int i = 0; i < span; ++i)
+        b->acc[i] ^= payload[sizeof(h) + i];
+    b->lenXor ^= h.lenXor;
+    if (span > b->span)
+        b->span = static_cast<uint16_t>(span);
+    rebuildFecFrame(*b);
+}
+
+void EspNowBus::rebuildFecFrame(FecRx &b)
+{
+    if (!b.parity || b.done)
+        return;
+    const uint16_t all = static_cast<uint16_t>((1u << b.count) - 1);
+    const uint16_t missing = all & ~b.have;
+    if (missing == 0)
+    {
+        b.done = true;
+        return;
+    }
+    if (missing & (missing - 1))
+        return; // two or more lost so far: one XOR parity cannot help (yet)
+    // the accumulator now holds exactly the missing payload, the length XOR its length
+    b.have |= missing;
+    b.done = true;
+    const uint16_t len = b.lenXor;
+    if (len > b.span)
+        return;
+    uint8_t pos = 0;
+    while (!(missing & (1u << pos)))
+        ++pos;
+    const uint16_t dataSeq = static_cast<uint16_t>(b.first + pos);
+    ESP_LOGD(TAG, "fec rebuilt dataSeq=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             static_cast<unsigned>(dataSeq), b.mac[0], b.mac[1], b.mac[2], b.mac[3], b.mac[4], b.mac[5]);
+    // a reliable stream must not NACK what was just rebuilt
+    int si = findSenderIndex(b.mac);
+    if (si >= 0 && senders_[si].relValid && !trackBroadcastGap(b.mac, dataSeq))
+        return; // a repair got here first
+    if (onReceive_)
+        onReceive_(b.mac, b.acc, len, true, true);
+}
+
+bool EspNowBus::trackBroadcastGap(const uint8_t mac[6], uint16_t dataSeq)
+{
+    // true when the frame is news: a newer dataSeq, or one still marked missing
+    int idx = ensureSender(mac);
+    if (idx < 0)
+        return true;
+    const uint32_t jitter = config_.nackDelayMs ? esp_random() % (static_cast<uint32_t>(config_.nackDelayMs) + 1) : 0;
+    const uint32_t nowMs = millis();
+    bool newGap = false;
+    bool fresh = true;
+    portENTER_CRITICAL(&txLock_);
+    SenderWindow &s = senders_[idx];
+    uint16_t ahead = static_cast<uint16_t>(dataSeq - s.relBase);
+    uint16_t behind = static_cast<uint16_t>(s.relBase - dataSeq);
+    if (s.relValid && ahead > 0 && ahead <= 32)
+    {
+        // everything between the previous newest and this frame is missing
+        const uint32_t gap = (1UL << (ahead - 1)) - 1;
+        s.relMissing = ((ahead >= 32) ? 0 : (s.relMissing << ahead)) | gap;
+        s.relBase = dataSeq;
+        newGap = gap != 0;
+    }
+    else if (s.relValid && behind > 0 && behind <= 32)
+    {
+        // a repair (or a late frame) fills a hole once; anything else here is a copy
+        const uint32_t bit = 1UL << (behind - 1);
+        fresh = (s.relMissing & bit) != 0;
+        s.relMissing &= ~bit;
+    }
+    else if (s.relValid && (ahead == 0 || ahead >= 0x8000))
+    {
+        fresh = false; // the newest again, or older than the window: never move relBase back
+    }
+    else
+    {
+        // first frame, or a jump ahead past the window (long outage): start over without NACKing
+        s.relValid = true;
+        s.relBase = dataSeq;
+        s.relMissing = 0;
+    }
+    if (newGap)
+    {
+        // wait a little (with jitter) so one NACK covers a burst and others' NACKs can suppress ours
+        s.nackTries = 0;
+        if (!s.nackArmed)
+        {
+            s.nackArmed = true;
+            armTimerLocked(kTimerNackBase + static_cast<size_t>(idx), nowMs + config_.nackDelayMs + jitter);
+        }
+    }
+    else if (s.relMissing == 0 && s.nackArmed)
+    {
+        s.nackArmed = false;
+        wheelUnlink(kTimerNackBase + static_cast<size_t>(idx));
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return fresh;
+}
+
+void EspNowBus::flushNack(size_t idx, uint32_t nowMs)
+{
+    NackPayload nack{};
+    bool send = false;
+    portENTER_CRITICAL(&txLock_);
+    SenderWindow &s = senders_[idx];
+    if (s.inUse && s.nackArmed && s.relMissing != 0 && s.nackTries < kNackRetries)
+    {
+        memcpy(nack.target, s.mac, 6);
+        nack.base = s.relBase;
+        nack.missing = s.relMissing;
+        ++s.nackTries;
+        armTimerLocked(kTimerNackBase + idx, nowMs + (static_cast<uint32_t>(config_.nackDelayMs) << s.nackTries));
+        send = true;
+    }
+    else
+    {
+        // repaired, or no longer in the sender's history after kNackRetries asks: give up on the rest
+        s.relMissing = 0;
+        s.nackArmed = false;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    if (!send)
+        return;
+    ESP_LOGD(TAG, "nack base=%u missing=%08X mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             static_cast<unsigned>(nack.base), static_cast<unsigned>(nack.missing),
+             nack.target[0], nack.target[1], nack.target[2], nack.target[3], nack.target[4], nack.target[5]);
+    enqueueCommon(Dest::Broadcast, PacketType::ControlNack, kBroadcastMac, &nack, sizeof(nack), 0, Priority::Control);
+}
+
+void EspNowBus::processNack(const uint8_t mac[6], const NackPayload &nack)
+{
+    const uint32_t nowMs = millis();
+    if (memcmp(nack.target, selfMac_, 6) != 0)
+    {
+        // overheard: if another receiver already asked for everything we miss, hold our NACK back a round
+        int idx = findSenderIndex(nack.target);
+        if (idx < 0)
+            return;
+        portENTER_CRITICAL(&txLock_);
+        SenderWindow &s = senders_[idx];
+        if (s.nackArmed && s.relMissing != 0)
+        {
+            const int16_t shift = static_cast<int16_t>(s.relBase - nack.base);
+            uint32_t theirs = 0;
+            if (shift >= 0 && shift < 32)
+                theirs = nack.missing << shift;
+            else if (shift < 0 && shift > -32)
+                theirs = nack.missing >> -shift;
+            if ((s.relMissing & ~theirs) == 0)
+                armTimerLocked(kTimerNackBase + static_cast<size_t>(idx), nowMs + config_.nackDelayMs);
+        }
+        portEXIT_CRITICAL(&txLock_);
+        return;
+    }
+    if (config_.broadcastHistory == 0)
+        return;
+    unsigned repaired = 0;
+    // oldest first, so receivers fill their windows in order
+    for (int n = 31; n >= 0; --n)
+    {
+        if (!(nack.missing & (1UL << n)))
+            continue;
+        const uint16_t dataSeq = static_cast<uint16_t>(nack.base - 1 - n);
+        TxItem item{};
+        portENTER_CRITICAL(&txLock_);
+        BcastHistory &h = bcastHistory_[dataSeq % config_.broadcastHistory];
+        // NACKs from several receivers within nackDelayMs share one repair
+        const bool take = h.valid && h.dataSeq == dataSeq && !(h.repaired && nowMs - h.repairedMs < config_.nackDelayMs);
+        if (take)
+        {
+            h.repaired = true;
+            h.repairedMs = nowMs;
+            bufferRefs_[h.bufferIndex].fetch_add(1, std::memory_order_acq_rel);
+            item.bufferIndex = h.bufferIndex;
+            item.len = h.len;
+            // a fresh header seq: the original's may already be past receivers' replay windows.
+            // Receivers drop the copy by its dataSeq if they have the frame
+            item.seq = ++broadcastSeq_;
+        }
+        portEXIT_CRITICAL(&txLock_);
+        if (!take)
+            continue;
+        item.dest = Dest::Broadcast;
+        item.pktType = PacketType::DataBroadcast;
+        item.priority = Priority::Interactive;
+        item.isRetry = true;
+        item.repair = true;
+        memcpy(item.mac, kBroadcastMac, 6);
+        if (!pushTx(item))
+        {
+            freeBuffer(item.bufferIndex);
+            break;
+        }
+        ++repaired;
+    }
+    if (repaired == 0)
+        return;
+    ESP_LOGD(TAG, "nack from %02X:%02X:%02X:%02X:%02X:%02X: %u repairs queued",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], repaired);
+    wakeSendTask();
+}
+
+void EspNowBus::sendTaskTrampoline(void *arg)
+{
+    auto *self = static_cast<EspNowBus *>(arg);
+    self->selfTaskHandle_ = xTaskGetCurrentTaskHandle();
+    self->sendTaskLoop();
+}
+
+bool EspNowBus::startSend(TxItem &item)
+{
+    uint8_t *buf = bufferPtr(item.bufferIndex);
+    if (!buf)
+        return false;
+    if (item.shared)
+    {
+        // fan-out payload: the header belongs to whichever peer is sent now (ESP-NOW copies the frame)
+        buf[0] = kMagic;
+        buf[1] = kVersion;
+        buf[2] = item.pktType;
+        buf[3] = 0;
+        buf[4] = static_cast<uint8_t>(item.msgId & 0xFF);
+        buf[5] = static_cast<uint8_t>((item.msgId >> 8) & 0xFF);
+    }
+    // Piggyback a held AppAck for this peer; a retry keeps whatever the first attempt carried
+    AppAckPayload ack{};
+    if ((item.pktType == PacketType::DataUnicast || item.pktType == PacketType::DataUnicastBatch) && !item.shared && !(buf[3] & kFlagAppAck) &&
+        item.len + sizeof(AppAckPayload) <= bufferCapacity(item.bufferIndex) && takePendingAck(item.mac, ack))
+    {
+        memmove(buf + kHeaderSize + sizeof(AppAckPayload), buf + kHeaderSize, item.len - kHeaderSize);
+        memcpy(buf + kHeaderSize, &ack, sizeof(ack));
+        buf[3] |= kFlagAppAck;
+        item.len = static_cast<uint16_t>(item.len + sizeof(AppAckPayload));
+    }
+    if (item.pktType == PacketType::DataBroadcast && (buf[3] & (kFlagReliable | kFlagFec)) && !item.isRetry)
+        recordBroadcast(item, buf);
+    if (item.repair)
+    {
+        // the history buffer still carries the original seq; the tag is recomputed below
+        buf[4] = static_cast<uint8_t>(item.seq & 0xFF);
+        buf[5] = static_cast<uint8_t>((item.seq >> 8) & 0xFF);
+    }
+    // update header flags/msgId for retry
+    if (item.isRetry)
+    {
+        buf[3] |= kFlagRetry;
+    }
+    // Recompute auth tag if needed (flags change alters HMAC input)
+    if (item.pktType == PacketType::DataBroadcast ||
+        item.pktType == PacketType::ControlJoinReq ||
+        item.pktType == PacketType::ControlJoinAck ||
+        item.pktType == PacketType::ControlAppAck ||
+        item.pktType == PacketType::ControlHeartbeat ||
+        item.pktType == PacketType::ControlLeave ||
+        item.pktType == PacketType::ControlNack ||
+        item.pktType == PacketType::DataFecParity)
+    {
+        const uint8_t *key = (item.pktType == PacketType::ControlJoinReq ||
+                              item.pktType == PacketType::ControlJoinAck ||
+                              item.pktType == PacketType::ControlAppAck ||
+                              item.pktType == PacketType::ControlHeartbeat)
+                                 ? derived_.keyAuth
+                                 : derived_.keyBcast;
+        if (item.len >= kHeaderSize + 4 + kAuthTagLen)
+        {
+            size_t tagOffset = static_cast<size_t>(item.len) - kAuthTagLen;
+            computeAuthTag(buf + tagOffset, buf, tagOffset, key);
+        }
+    }
+    const uint8_t *targetMac = item.mac;
+    esp_err_t err = esp_now_send(targetMac, buf, item.len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_now_send failed err=%d mac=%02X:%02X:%02X:%02X:%02X:%02X len=%u",
+                 static_cast<int>(err),
+                 targetMac[0], targetMac[1], targetMac[2], targetMac[3], targetMac[4], targetMac[5],
+                 static_cast<unsigned>(item.len));
+        return false;
+    }
+    if (memcmp(targetMac, kBroadcastMac, 6) == 0)
+        paceBroadcast(item);
+    return true;
+}
+
+uint32_t EspNowBus::frameAirtimeUs(size_t len) const
+{
+    // ESP-NOW wraps the packet in a vendor action frame: MAC header 24, category/OUI/random 8, vendor IE 7, FCS 4
+    const uint32_t bits = (static_cast<uint32_t>(len) + 43) * 8;
+    uint32_t rateX10 = 0; // DSSS/LoRa: 100 kbit/s units
+    uint32_t dbps = 0;    // OFDM/HT: data bits per symbol
+    uint32_t preambleUs = 192;
+    bool sgi = false;
+    switch (config_.phyRate)
+    {
+    case WIFI_PHY_RATE_1M_L:
+        rateX10 = 10;
+        break;
+    case WIFI_PHY_RATE_2M_L:
+        rateX10 = 20;
+        break;
+    case WIFI_PHY_RATE_5M_L:
+        rateX10 = 55;
+        break;
+    case WIFI_PHY_RATE_11M_L:
+        rateX10 = 110;
+        break;
+    case WIFI_PHY_RATE_2M_S:
+        rateX10 = 20;
+        preambleUs = 96;
+        break;
+    case WIFI_PHY_RATE_5M_S:
+        rateX10 = 55;
+        preambleUs = 96;
+        break;
+    case WIFI_PHY_RATE_11M_S:
+        rateX10 = 110;
+        preambleUs = 96;
+        break;
+    case WIFI_PHY_RATE_6M:
+        dbps = 24;
+        break;
+    case WIFI_PHY_RATE_9M:
+        dbps = 36;
+        break;
+    case WIFI_PHY_RATE_12M:
+        dbps = 48;
+        break;
+    case WIFI_PHY_RATE_18M:
+        dbps = 72;
+        break;
+    case WIFI_PHY_RATE_24M:
+        dbps = 96;
+        break;
+    case WIFI_PHY_RATE_36M:
+        dbps = 144;
+        break;
+    case WIFI_PHY_RATE_48M:
+        dbps = 192;
+        break;
+    case WIFI_PHY_RATE_54M:
+        dbps = 216;
+        break;
+    case WIFI_PHY_RATE_LORA_250K:
+        rateX10 = 2; // rounded down to 200 kbit/s
+        break;
+    case WIFI_PHY_RATE_LORA_500K:
+        rateX10 = 5;
+        break;
+    default:
+        if (config_.phyRate >= WIFI_PHY_RATE_MCS0_LGI && config_.phyRate <= WIFI_PHY_RATE_MCS7_SGI)
+        {
+            static const uint16_t kHtDbps[8] = {26, 52, 78, 104, 156, 208, 234, 260};
+            size_t mcs = static_cast<size_t>(config_.phyRate - WIFI_PHY_RATE_MCS0_LGI);
+            sgi = mcs >= 8;
+            dbps = kHtDbps[mcs & 7];
+        }
+        else
+        {
+            rateX10 = 10; // unknown: assume the slowest rate
+        }
+        break;
+    }
+    if (rateX10 > 0)
+    {
+        // DSSS: PLCP preamble/header, then DIFS (SIFS 10 + 2 x 20 us slots) and mean backoff (CWmin 31 -> 15 slots)
+        return preambleUs + (bits * 10 + rateX10 - 1) / rateX10 + 50 + 15 * 20;
+    }
+    // OFDM: 16 service + 6 tail bits; HT-mixed adds HT-SIG/STF/LTF to the 20 us legacy preamble; 6 us signal
+    // extension; DIFS (SIFS 10 + 2 x 9 us slots) and mean backoff (CWmin 15 -> 7 slots)
+    const uint32_t symbols = (bits + 22 + dbps - 1) / dbps;
+    const uint32_t dataUs = sgi ? (symbols * 36 + 9) / 10 : symbols * 4;
+    preambleUs = (config_.phyRate >= WIFI_PHY_RATE_MCS0_LGI) ? 36 : 20;
+    return preambleUs + dataUs + 6 + 28 + 7 * 9;
+}
+
+void EspNowBus::refillAir(AirBucket &b, uint32_t rateMsPerSec, uint32_t nowUs)
+{
+    // tokens are airtime microseconds earned at rateMsPerSec; a bucket holds at most 100 ms of its budget
+    const int32_t cap = static_cast<int32_t>(rateMsPerSec) * 100;
+    if (!b.primed)
+    {
+        b.primed = true;
+        b.tokensUs = cap;
+        b.stampUs = nowUs;
+        return;
+    }
+    uint64_t gain = static_cast<uint64_t>(nowUs - b.stampUs) * rateMsPerSec / 1000;
+    if (gain == 0)
+        return; // keep the stamp so short intervals still add up
+    int64_t tokens = static_cast<int64_t>(b.tokensUs) + static_cast<int64_t>(gain);
+    b.tokensUs = tokens > cap ? cap : static_cast<int32_t>(tokens);
+    b.stampUs = nowUs;
+}
+
+bool EspNowBus::airtimeBlocked(const TxLane &lane) const
+{
+    return (config_.airtimeBudgetMsPerSec > 0 && airGlobal_.tokensUs <= 0) ||
+           (config_.peerAirtimeBudgetMsPerSec > 0 && lane.air.tokensUs <= 0);
+}
+
+bool EspNowBus::laneIdle(const TxLane &lane) const
+{
+    return lane.count == 0 && (config_.peerAirtimeBudgetMsPerSec == 0 || lane.air.tokensUs > 0);
+}
+
+void EspNowBus::serviceAirtimeLocked(uint32_t nowUs)
+{
+    const uint32_t globalRate = config_.airtimeBudgetMsPerSec;
+    const uint32_t peerRate = config_.peerAirtimeBudgetMsPerSec;
+    if (globalRate == 0 && peerRate == 0)
+        return;
+    bool waiting = false;
+    uint32_t waitUs = 0;
+    auto refillTime = [&](int32_t tokensUs, uint32_t rate)
+    {
+        if (tokensUs > 0)
+            return;
+        uint32_t us = static_cast<uint32_t>((static_cast<uint64_t>(1 - static_cast<int64_t>(tokensUs)) * 1000 + rate - 1) / rate);
+        if (!waiting || us < waitUs)
+            waitUs = us;
+        waiting = true;
+    };
+    if (globalRate > 0)
+    {
+        refillAir(airGlobal_, globalRate, nowUs);
+        if (txQueued_ > 0)
+            refillTime(airGlobal_.tokensUs, globalRate);
+    }
+    if (peerRate > 0)
+    {
+        for (auto &lane : lanes_)
+        {
+            if (!lane.inUse)
+                continue;
+            refillAir(lane.air, peerRate, nowUs);
+            if (lane.count > 0)
+                refillTime(lane.air.tokensUs, peerRate);
+            else if (laneIdle(lane))
+                lane.inUse = false; // debt repaid
+        }
+    }
+    if (waiting)
+        armTimerLocked(kTimerAirtime, millis() + (waitUs + 999) / 1000);
+}
+
+bool EspNowBus::rejectIfOverBudget(const uint8_t mac[6], size_t len)
+{
+    const uint32_t globalRate = config_.airtimeBudgetMsPerSec;
+    const uint32_t peerRate = config_.peerAirtimeBudgetMsPerSec;
+    if (globalRate == 0 && peerRate == 0)
+        return false;
+    // the backlog already queued counts against the bucket, so the queue cannot run far ahead of the budget
+    const int32_t cost = static_cast<int32_t>(frameAirtimeUs(kHeaderSize + len));
+    const uint32_t nowUs = micros();
+    bool over = false;
+    portENTER_CRITICAL(&txLock_);
+    if (globalRate > 0)
+    {
+        refillAir(airGlobal_, globalRate, nowUs);
+        over = airGlobal_.tokensUs - static_cast<int32_t>(txQueued_) * cost <= 0;
+    }
+    int li = (!over && peerRate > 0) ? findLane(mac) : -1;
+    if (li >= 0)
+    {
+        refillAir(lanes_[li].air, peerRate, nowUs);
+        over = lanes_[li].air.tokensUs - static_cast<int32_t>(lanes_[li].count) * cost <= 0;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    if (!over)
+        return false;
+    if (onSendResult_)
+        onSendResult_(mac, SendStatus::RateLimited);
+    ESP_LOGD(TAG, "airtime budget exhausted: reject mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return true;
+}
+
+bool EspNowBus::windowOpen(const uint8_t mac[6]) const
+{
+    uint8_t window = config_.sendWindow;
+    if (config_.congestionControl == CongestionMode::PerPeer)
+    {
+        int idx = findPeerIndex(mac);
+        if (idx >= 0 && (peers_[idx].cwndQ8 >> 8) < window)
+            window = static_cast<uint8_t>(peers_[idx].cwndQ8 >> 8);
+    }
+    else if (config_.congestionControl == CongestionMode::Group)
+    {
+        size_t awaiting = 0;
+        for (size_t i = 0; i < kMaxInFlight; ++i)
+        {
+            if (inflight_[i].inUse && inflight_[i].item.expectAck)
+                ++awaiting;
+        }
+        if (awaiting >= (groupCwndQ8_ >> 8))
+            return false;
+    }
+    return inFlightCount(mac) < window;
+}
+
+void EspNowBus::congestionOnAck(const uint8_t mac[6])
+{
+    // additive increase: about one frame per window's worth of AppAcks
+    uint16_t *cwnd = nullptr;
+    uint32_t maxQ8 = 0;
+    if (config_.congestionControl == CongestionMode::PerPeer)
+    {
+        int idx = findPeerIndex(mac);
+        if (idx < 0)
+            return;
+        cwnd = &peers_[idx].cwndQ8;
+        maxQ8 = static_cast<uint32_t>(config_.sendWindow) << 8;
+    }
+    else if (config_.congestionControl == CongestionMode::Group)
+    {
+        cwnd = &groupCwndQ8_;
+        maxQ8 = static_cast<uint32_t>(kMaxInFlight) << 8;
+    }
+    else
+    {
+        return;
+    }
+    uint32_t next = *cwnd + (256u * 256u) / *cwnd;
+    *cwnd = static_cast<uint16_t>(next > maxQ8 ? maxQ8 : next);
+}
+
+void EspNowBus::congestionOnLoss(const uint8_t mac[6])
+{
+    // multiplicative decrease, once per loss event (one RTO), never below one frame
+    if (config_.congestionControl == CongestionMode::Off || memcmp(mac, kBroadcastMac, 6) == 0)
+        return;
+    int idx = findPeerIndex(mac);
+    if (idx < 0)
+        return;
+    const uint32_t nowMs = millis();
+    const uint32_t rtoMs = peerRtoMs(mac);
+    uint16_t &cwnd = (config_.congestionControl == CongestionMode::PerPeer) ? peers_[idx].cwndQ8 : groupCwndQ8_;
+    uint32_t &cutMs = (config_.congestionControl == CongestionMode::PerPeer) ? peers_[idx].cwndCutMs : groupCwndCutMs_;
+    if (cutMs != 0 && nowMs - cutMs < rtoMs)
+        return;
+    cutMs = nowMs;
+    cwnd = static_cast<uint16_t>(cwnd / 2 < 256 ? 256 : cwnd / 2);
+    ESP_LOGD(TAG, "cwnd cut to %u.%02u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             static_cast<unsigned>(cwnd >> 8), static_cast<unsigned>((cwnd & 0xFF) * 100 / 256),
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+void EspNowBus::paceBroadcast(const TxItem &item)
+{
+    uint32_t gapUs = frameAirtimeUs(item.len);
+    if (config_.broadcastJitterMs > 0)
+        gapUs += esp_random() % (static_cast<uint32_t>(config_.broadcastJitterMs) * 1000 + 1);
+    const uint32_t nowUs = micros();
+    portENTER_CRITICAL(&txLock_);
+    bcastPaced_ = true;
+    bcastPaceUntilUs_ = nowUs + gapUs;
+    // wake once the gap has passed in case only broadcast frames are waiting
+    armTimerLocked(kTimerBcastPace, millis() + (gapUs + 999) / 1000);
+    portEXIT_CRITICAL(&txLock_);
+}
+
+void EspNowBus::wakeSendTask()
+{
+    TaskHandle_t task = sendTask_;
+    if (task)
+        xTaskNotify(task, kNotifyWake, eSetBits);
+}
+
+void EspNowBus::queueAppAck(int peerIdx, const uint8_t mac[6], uint16_t msgId)
+{
+    AppAckPayload ack{};
+    ack.msgId = msgId;
+    if (peerIdx < 0)
+    {
+        enqueueCommon(Dest::Unicast, PacketType::ControlAppAck, mac, &ack, sizeof(ack), 0, Priority::Control);
+        return;
+    }
+    if (config_.appAckDelayMs == 0)
+    {
+        portENTER_CRITICAL(&txLock_);
+        buildAppAck(peers_[peerIdx], ack);
+        portEXIT_CRITICAL(&txLock_);
+        enqueueCommon(Dest::Unicast, PacketType::ControlAppAck, mac, &ack, sizeof(ack), 0, Priority::Control);
+        return;
+    }
+    // The ack is built from the msgId window when it leaves, so one held ack covers every frame since
+    portENTER_CRITICAL(&txLock_);
+    PeerInfo &peer = peers_[peerIdx];
+    if (!peer.ackPending)
+    {
+        peer.ackPending = true;
+        peer.ackDueMs = millis() + config_.appAckDelayMs;
+        armTimerLocked(kTimerAckBase + static_cast<size_t>(peerIdx), peer.ackDueMs);
+    }
+    portEXIT_CRITICAL(&txLock_);
+    wakeSendTask();
+}
+
+void EspNowBus::buildAppAck(const PeerInfo &peer, AppAckPayload &ack) const
+{
+    if (!peer.rxMsgValid)
+        return;
+    ack.msgId = peer.rxMsgBase;
+    ack.bits = peer.rxMsgWindow;
+}
+
+bool EspNowBus::takePendingAck(const uint8_t mac[6], AppAckPayload &ack)
+{
+    bool found = false;
+    portENTER_CRITICAL(&txLock_);
+    int idx = findPeerIndex(mac);
+    if (idx >= 0 && peers_[idx].ackPending && peers_[idx].rxMsgValid)
+    {
+        peers_[idx].ackPending = false;
+        buildAppAck(peers_[idx], ack);
+        found = true;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+void EspNowBus::flushAppAck(size_t idx, uint32_t nowMs)
+{
+    auto &p = peers_[idx];
+    AppAckPayload ack{};
+    bool due = false;
+    portENTER_CRITICAL(&txLock_);
+    if (p.inUse && p.ackPending)
+    {
+        if (static_cast<int32_t>(nowMs - p.ackDueMs) >= 0)
+        {
+            p.ackPending = false;
+            buildAppAck(p, ack);
+            due = true;
+        }
+        else
+        {
+            armTimerLocked(kTimerAckBase + idx, p.ackDueMs);
+        }
+    }
+    portEXIT_CRITICAL(&txLock_);
+    // no reverse traffic showed up in time
+    if (due)
+        enqueueCommon(Dest::Unicast, PacketType::ControlAppAck, p.mac, &ack, sizeof(ack), 0, Priority::Control);
+}
+
+void EspNowBus::processAppAck(const uint8_t mac[6], int peerIdx, const AppAckPayload &ack, bool cumulative)
+{
+    if (peerIdx >= 0 && !acceptAppAck(peers_[peerIdx], ack.msgId, cumulative))
+    {
+        // routine: a retransmitted DataUnicast still carries the ack piggybacked on its first attempt
+        ESP_LOGD(TAG, "app-ack replay drop msgId=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 ack.msgId,
+                 mac ? mac[0] : 0, mac ? mac[1] : 0, mac ? mac[2] : 0,
+                 mac ? mac[3] : 0, mac ? mac[4] : 0, mac ? mac[5] : 0);
+        return;
+    }
+    if (peerIdx >= 0)
+    {
+        peers_[peerIdx].lastSeenMs = millis();
+        peers_[peerIdx].heartbeatStage = 0;
+        peers_[peerIdx].ready = true;
+    }
+    // Entries in the window may be acked out of order; the send task reports and frees them
+    uint16_t ids[kMaxAckedIds];
+    uint8_t n = markAppAcked(mac, ack, ids);
+    if (n == 0)
+    {
+        // cumulative acks repeat what the previous one already confirmed, so silence is normal there
+        if (cumulative)
+            ESP_LOGD(TAG, "app-ack nothing new msgId=%u", ack.msgId);
+        else
+            ESP_LOGW(TAG, "app-ack late or no in-flight msgId=%u", ack.msgId);
+    }
+    if (onAppAck_)
+    {
+        for (uint8_t i = 0; i < n; ++i)
+            onAppAck_(mac, ids[i]);
+    }
+}
+
+void EspNowBus::updateRtt(PeerInfo &peer, uint32_t sampleMs)
+{
+    // Jacobson/Karels in fixed point: srtt += (R - srtt) / 8, rttvar += (|R - srtt| - rttvar) / 4
+    if (!peer.rttValid)
+    {
+        peer.srtt8 = sampleMs << 3;
+        peer.rttvar4 = sampleMs << 1;
+        peer.rttValid = true;
+    }
+    else
+    {
+        int32_t delta = static_cast<int32_t>(sampleMs) - static_cast<int32_t>(peer.srtt8 >> 3);
+        peer.srtt8 = static_cast<uint32_t>(static_cast<int32_t>(peer.srtt8) + delta);
+        if (delta < 0)
+            delta = -delta;
+        delta -= static_cast<int32_t>(peer.rttvar4 >> 2);
+        peer.rttvar4 = static_cast<uint32_t>(static_cast<int32_t>(peer.rttvar4) + delta);
+    }
+    peer.rtoBackoff = 0;
+}
+
+uint32_t EspNowBus::peerRtoMs(const uint8_t mac[6]) const
+{
+    int idx = findPeerIndex(mac);
+    if (idx < 0)
+        return config_.txTimeoutMs;
+    const PeerInfo &peer = peers_[idx];
+    // RTO = srtt + 4 * rttvar (at least one tick of variance), before the first sample txTimeoutMs
+    uint32_t rto = config_.txTimeoutMs;
+    if (peer.rttValid)
+    {
+        uint32_t var = peer.rttvar4 > 0 ? peer.rttvar4 : 1;
+        rto = (peer.srtt8 >> 3) + var;
+        if (rto < config_.rtoMinMs)
+            rto = config_.rtoMinMs;
+    }
+    for (uint8_t i = 0; i < peer.rtoBackoff && rto < config_.rtoMaxMs; ++i)
+        rto <<= 1;
+    if (rto > config_.rtoMaxMs)
+        rto = config_.rtoMaxMs;
+    return rto;
+}
+
+uint32_t EspNowBus::retryBackoffMs(uint8_t attempt) const
+{
+    if (config_.retryDelayMs == 0)
+        return 0;
+    // Exponential backoff with "equal jitter": half fixed, half random, so nodes that collided once
+    // do not retry in lockstep
+    uint32_t delay = config_.retryDelayMs;
+    for (uint8_t i = 0; i < attempt && delay < config_.retryDelayMaxMs; ++i)
+        delay <<= 1;
+    if (delay > config_.retryDelayMaxMs)
+        delay = config_.retryDelayMaxMs;
+    uint32_t half = delay / 2;
+    return (delay - half) + (half > 0 ? esp_random() % (half + 1) : 0);
+}
+
+void EspNowBus::backoffRto(const uint8_t mac[6])
+{
+    portENTER_CRITICAL(&txLock_);
+    int idx = findPeerIndex(mac);
+    if (idx >= 0 && peers_[idx].rtoBackoff < 8)
+        peers_[idx].rtoBackoff++;
+    portEXIT_CRITICAL(&txLock_);
+}
+
+uint16_t EspNowBus::perPeerQueueCap() const
+{
+    uint16_t cap = config_.maxQueuePerPeer;
+    if (cap == 0 || cap > config_.maxQueueLength)
+        cap = config_.maxQueueLength;
+    return cap;
+}
+
+int EspNowBus::findLane(const uint8_t mac[6]) const
+{
+    for (size_t i = 0; i < kMaxLanes; ++i)
+    {
+        if (lanes_[i].inUse && memcmp(lanes_[i].mac, mac, 6) == 0)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool EspNowBus::laneEligible(const TxLane &lane, size_t cls) const
+{
+    if (lane.head[cls] < 0)
+        return false;
+    const TxItem &head = txNodes_[lane.head[cls]].item;
+    if (airtimeBlocked(lane) && (head.pktType == PacketType::DataUnicast || head.pktType == PacketType::DataBroadcast ||
+                                 head.pktType == PacketType::DataFragment || head.pktType == PacketType::DataBulk ||
+                                 head.pktType == PacketType::DataFecParity))
+        return false;
+    // broadcast frames hold back until the previous one has cleared the air
+    if (bcastPaced_ && static_cast<int32_t>(micros() - bcastPaceUntilUs_) < 0 && memcmp(lane.mac, kBroadcastMac, 6) == 0)
+        return false;
+    // Only frames that wait for an AppAck occupy the per-peer window; control frames pass straight through
+    return !head.expectAck || windowOpen(head.mac);
+}
+
+bool EspNowBus::pushTx(const TxItem &item)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&txLock_);
+    int li = findLane(item.mac);
+    if (li < 0)
+    {
+        for (size_t i = 0; i < kMaxLanes; ++i)
+        {
+            if (!lanes_[i].inUse)
+            {
+                li = static_cast<int>(i);
+                break;
+            }
+        }
+        for (size_t i = 0; li < 0 && i < kMaxLanes; ++i)
+        {
+            // all lanes taken: an empty lane kept only for its airtime debt gives way
+            if (lanes_[i].count == 0)
+                li = static_cast<int>(i);
+        }
+        if (li >= 0)
+        {
+            lanes_[li] = TxLane{};
+            lanes_[li].inUse = true;
+            memcpy(lanes_[li].mac, item.mac, 6);
+        }
+    }
+    // an FEC parity jumps its lane (and the lane cap): it must leave before the next block's queued frames
+    const bool front = item.pktType == PacketType::DataFecParity;
+    if (li >= 0 && txFreeNode_ >= 0 && (front || lanes_[li].count < perPeerQueueCap()))
+    {
+        TxLane &lane = lanes_[li];
+        size_t cls = static_cast<size_t>(item.priority);
+        int16_t n = txFreeNode_;
+        txFreeNode_ = txNodes_[n].next;
+        txNodes_[n].item = item;
+        txNodes_[n].next = -1;
+        if (front)
+        {
+            txNodes_[n].next = lane.head[cls];
+            lane.head[cls] = n;
+            if (lane.tail[cls] < 0)
+                lane.tail[cls] = n;
+        }
+        else if (lane.tail[cls] >= 0)
+        {
+            txNodes_[lane.tail[cls]].next = n;
+            lane.tail[cls] = n;
+        }
+        else
+        {
+            lane.head[cls] = n;
+            lane.tail[cls] = n;
+        }
+        lane.count++;
+        txQueued_++;
+        ok = true;
+    }
+    else if (li >= 0 && laneIdle(lanes_[li]))
+    {
+        lanes_[li].inUse = false;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return ok;
+}
+
+bool EspNowBus::replaceQueued(TxItem &item, TxItem &stale)
+{
+    bool found = false;
+    portENTER_CRITICAL(&txLock_);
+    int li = findLane(item.mac);
+    size_t cls = static_cast<size_t>(item.priority);
+    for (int16_t n = (li >= 0) ? lanes_[li].head[cls] : -1; n >= 0; n = txNodes_[n].next)
+    {
+        TxItem &q = txNodes_[n].item;
+        if (q.coalesceKey != item.coalesceKey || q.pktType != item.pktType)
+            continue;
+        // the newer frame inherits the queued id, so ids still leave in order and none is skipped
+        // past the receiver's window; a shared buffer gets its header in startSend, a broadcast its tag
+        item.msgId = q.msgId;
+        item.seq = q.seq;
+        if (!item.shared)
+        {
+            uint16_t idField = (item.pktType == PacketType::DataBroadcast) ? item.seq : item.msgId;
+            uint8_t *buf = bufferPtr(item.bufferIndex);
+            buf[4] = static_cast<uint8_t>(idField & 0xFF);
+            buf[5] = static_cast<uint8_t>((idField >> 8) & 0xFF);
+        }
+        stale = q;
+        q = item;
+        if (stale.shared)
+            ++fanoutNodesFree_; // the node now counts against the newer frame
+        found = true;
+        break;
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+bool EspNowBus::popTx(TxItem &out)
+{
+    bool found = false;
+    const uint32_t nowUs = micros();
+    portENTER_CRITICAL(&txLock_);
+    serviceAirtimeLocked(nowUs);
+    if (txQueued_ > 0 && allocInFlight() >= 0)
+    {
+        // Strict priority between classes: Interactive only runs when no Control frame can go, and so on
+        for (size_t cls = 0; cls < kPriorityCount && !found; ++cls)
+        {
+            found = popTxClass(cls, out);
+        }
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+bool EspNowBus::popTxClass(size_t cls, TxItem &out)
+{
+    // Deficit round robin within a class: each backlogged lane earns maxPayloadBytes per round and sends
+    // while its credit covers the head frame, so a peer stuck on timeouts cannot hold back the other lanes.
+    const int32_t quantum = config_.maxPayloadBytes;
+    uint8_t &cursor = laneCursor_[cls];
+    for (size_t n = 0; n <= kMaxLanes; ++n)
+    {
+        TxLane &lane = lanes_[cursor];
+        if (lane.inUse && laneEligible(lane, cls))
+        {
+            if (!laneGranted_[cls])
+            {
+                lane.deficit[cls] += quantum;
+                laneGranted_[cls] = true;
+            }
+            int16_t h = lane.head[cls];
+            if (lane.deficit[cls] >= txNodes_[h].item.len)
+            {
+                lane.deficit[cls] -= txNodes_[h].item.len;
+                if (config_.airtimeBudgetMsPerSec > 0 || config_.peerAirtimeBudgetMsPerSec > 0)
+                {
+                    // every frame is charged, control included; only data is held back by a bucket in debt
+                    const int32_t cost = static_cast<int32_t>(frameAirtimeUs(txNodes_[h].item.len));
+                    airGlobal_.tokensUs -= cost;
+                    lane.air.tokensUs -= cost;
+                }
+                unlinkTxNode(cursor, cls, -1, out);
+                return true;
+            }
+        }
+        cursor = static_cast<uint8_t>((cursor + 1) % kMaxLanes);
+        laneGranted_[cls] = false;
+    }
+    return false;
+}
+
+void EspNowBus::unlinkTxNode(size_t li, size_t cls, int16_t prev, TxItem &out)
+{
+    // removes the node after `prev` (the head when prev < 0)
+    TxLane &lane = lanes_[li];
+    int16_t h = (prev < 0) ? lane.head[cls] : txNodes_[prev].next;
+    out = txNodes_[h].item;
+    if (prev < 0)
+        lane.head[cls] = txNodes_[h].next;
+    else
+        txNodes_[prev].next = txNodes_[h].next;
+    if (lane.tail[cls] == h)
+        lane.tail[cls] = prev;
+    if (lane.head[cls] < 0)
+    {
+        // an emptied class gives up its credit
+        lane.tail[cls] = -1;
+        lane.deficit[cls] = 0;
+        if (laneCursor_[cls] == li)
+        {
+            laneCursor_[cls] = static_cast<uint8_t>((li + 1) % kMaxLanes);
+            laneGranted_[cls] = false;
+        }
+    }
+    lane.count--;
+    txQueued_--;
+    if (out.shared)
+        ++fanoutNodesFree_;
+    txNodes_[h].next = txFreeNode_;
+    txFreeNode_ = h;
+    if (laneIdle(lane))
+        lane.inUse = false;
+}
+
+bool EspNowBus::isExpired(const TxItem &item, uint32_t nowMs)
+{
+    return item.hasExpiry && static_cast<int32_t>(nowMs - item.expiresMs) >= 0;
+}
+
+bool EspNowBus::popExpiredTx(uint32_t nowMs, TxItem &out)
+{
+    // a pass that finds nothing has seen every queued frame, so it also leaves the next expiry behind
+    bool found = false;
+    bool pending = false;
+    uint32_t nextMs = 0;
+    portENTER_CRITICAL(&txLock_);
+    for (size_t li = 0; li < kMaxLanes && !found; ++li)
+    {
+        if (!lanes_[li].inUse)
+            continue;
+        for (size_t cls = 0; cls < kPriorityCount && !found; ++cls)
+        {
+            int16_t prev = -1;
+            for (int16_t n = lanes_[li].head[cls]; n >= 0; prev = n, n = txNodes_[n].next)
+            {
+                const TxItem &q = txNodes_[n].item;
+                if (isExpired(q, nowMs))
+                {
+                    unlinkTxNode(li, cls, prev, out);
+                    found = true;
+                    break;
+                }
+                if (q.hasExpiry && (!pending || static_cast<int32_t>(q.expiresMs - nextMs) < 0))
+                {
+                    pending = true;
+                    nextMs = q.expiresMs;
+                }
+            }
+        }
+    }
+    if (!found)
+    {
+        txExpiryPending_ = pending;
+        txNextExpiryMs_ = nextMs;
+        if (pending)
+            armTimerLocked(kTimerQueueTtl, nextMs);
+        else
+            wheelUnlink(kTimerQueueTtl);
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+void EspNowBus::dropExpiredTx(uint32_t nowMs)
+{
+    // sweep every lane, not just the heads: frames stuck behind a full send window expire too
+    TxItem item{};
+    while (popExpiredTx(nowMs, item))
+    {
+        ESP_LOGD(TAG, "expired in queue id=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 static_cast<unsigned>(item.msgId ? item.msgId : item.seq),
+                 item.mac[0], item.mac[1], item.mac[2], item.mac[3], item.mac[4], item.mac[5]);
+        reportSendResult(item, SendStatus::Expired);
+        freeBuffer(item.bufferIndex);
+    }
+}
+
+bool EspNowBus::popPeerDataTx(const uint8_t mac[6], TxItem &out)
+{
+    bool found = false;
+    portENTER_CRITICAL(&txLock_);
+    int li = findLane(mac);
+    for (size_t cls = 0; li >= 0 && cls < kPriorityCount && !found; ++cls)
+    {
+        int16_t prev = -1;
+        for (int16_t n = lanes_[li].head[cls]; n >= 0; prev = n, n = txNodes_[n].next)
+        {
+            const PacketType t = txNodes_[n].item.pktType;
+            if (t == PacketType::DataUnicast || t == PacketType::DataFragment || t == PacketType::DataBulk)
+            {
+                unlinkTxNode(static_cast<size_t>(li), cls, prev, out);
+                found = true;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+bool EspNowBus::popTxFollower(const TxItem &lead, size_t room, uint16_t firstMsgId, TxItem &out)
+{
+    bool found = false;
+    portENTER_CRITICAL(&txLock_);
+    int li = findLane(lead.mac);
+    size_t cls = static_cast<size_t>(lead.priority);
+    if (li >= 0 && lanes_[li].head[cls] >= 0)
+    {
+        TxLane &lane = lanes_[li];
+        const TxItem &h = txNodes_[lane.head[cls]].item;
+        // every record must stay inside the receiver's 32-entry msgId window, or a retransmitted
+        // container would slip its oldest records past duplicate detection
+        if (h.pktType == PacketType::DataUnicast && !h.shared && h.expectAck == lead.expectAck && h.hasExpiry == lead.hasExpiry &&
+            kBatchRecordHeader + h.len - kHeaderSize <= room &&
+            static_cast<uint16_t>(h.msgId - firstMsgId) < kReplayWindow)
+        {
+            lane.deficit[cls] = (lane.deficit[cls] > h.len) ? lane.deficit[cls] - h.len : 0;
+            unlinkTxNode(static_cast<size_t>(li), cls, -1, out);
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+void EspNowBus::coalesceUnicast(TxItem &lead)
+{
+    if (!config_.aggregateUnicast || lead.pktType != PacketType::DataUnicast || lead.shared)
+        return;
+    uint8_t *buf = bufferPtr(lead.bufferIndex);
+    if (!buf)
+        return;
+    const uint16_t firstMsgId = lead.msgId;
+    auto putRecord = [](uint8_t *at, uint16_t msgId, size_t len)
+    {
+        at[0] = static_cast<uint8_t>(msgId & 0xFF);
+        at[1] = static_cast<uint8_t>((msgId >> 8) & 0xFF);
+        at[2] = static_cast<uint8_t>(len & 0xFF);
+        at[3] = static_cast<uint8_t>((len >> 8) & 0xFF);
+    };
+    TxItem next{};
+    while (lead.batchCount < UINT8_MAX)
+    {
+        size_t room = bufferCapacity(lead.bufferIndex) - lead.len;
+        if (lead.pktType == PacketType::DataUnicast)
+            room = (room > kBatchRecordHeader) ? room - kBatchRecordHeader : 0; // the lead needs a record header too
+        if (!popTxFollower(lead, room, firstMsgId, next))
+            break;
+        if (lead.pktType == PacketType::DataUnicast)
+        {
+            // turn the lead frame into a container holding itself as the first record
+            size_t leadLen = lead.len - kHeaderSize;
+            memmove(buf + kHeaderSize + kBatchRecordHeader, buf + kHeaderSize, leadLen);
+            putRecord(buf + kHeaderSize, lead.msgId, leadLen);
+            lead.len = static_cast<uint16_t>(lead.len + kBatchRecordHeader);
+            lead.pktType = PacketType::DataUnicastBatch;
+            buf[2] = PacketType::DataUnicastBatch;
+        }
+        if (isExpired(next, millis()))
+        {
+            reportSendResult(next, SendStatus::Expired);
+            freeBuffer(next.bufferIndex);
+            continue;
+        }
+        // the container expires with its oldest record, so no record goes on air (or is retransmitted) past
+        // its deadline; followers share the lead's expiry mode, so a message without ttlMs is never cut short
+        if (lead.hasExpiry && static_cast<int32_t>(next.expiresMs - lead.expiresMs) < 0)
+            lead.expiresMs = next.expiresMs;
+        const uint8_t *src = bufferPtr(next.bufferIndex);
+        size_t len = next.len - kHeaderSize;
+        putRecord(buf + lead.len, next.msgId, len);
+        memcpy(buf + lead.len + kBatchRecordHeader, src + kHeaderSize, len);
+        lead.len = static_cast<uint16_t>(lead.len + kBatchRecordHeader + len);
+        lead.batchCount++;
+        // the header carries the newest msgId; an AppAck covering it covers the whole container
+        lead.msgId = next.msgId;
+        buf[4] = static_cast<uint8_t>(lead.msgId & 0xFF);
+        buf[5] = static_cast<uint8_t>((lead.msgId >> 8) & 0xFF);
+        freeBuffer(next.bufferIndex);
+    }
+    if (lead.batchCount > 1)
+    {
+        ESP_LOGV(TAG, "batched %u messages len=%u mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 static_cast<unsigned>(lead.batchCount), static_cast<unsigned>(lead.len),
+                 lead.mac[0], lead.mac[1], lead.mac[2], lead.mac[3], lead.mac[4], lead.mac[5]);
+    }
+}
+
+void EspNowBus::reportSendResult(const TxItem &item, SendStatus status)
+{
+    // bulk chunks report through onBulkProgress instead; broadcast repairs were reported on first send
+    if (!onSendResult_ || item.pktType == PacketType::DataBulk || item.repair)
+        return;
+    // one result per user message, also for containers
+    for (uint8_t i = 0; i < item.batchCount; ++i)
+        onSendResult_(item.mac, status);
+}
+
+int EspNowBus::allocInFlight()
+{
+    for (size_t i = 0; i < kMaxInFlight; ++i)
+    {
+        if (!inflight_[i].inUse)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+uint8_t EspNowBus::inFlightCount(const uint8_t mac[6]) const
+{
+    uint8_t cnt = 0;
+    for (size_t i = 0; i < kMaxInFlight; ++i)
+    {
+        const auto &e = inflight_[i];
+        if (e.inUse && e.item.expectAck && memcmp(e.item.mac, mac, 6) == 0)
+            ++cnt;
+    }
+    return cnt;
+}
+
+uint8_t EspNowBus::markAppAcked(const uint8_t mac[6], const AppAckPayload &ack, uint16_t *ackedIds)
+{
+    // returns the msgIds of every user message completed, so a container reports each of its records
+    uint8_t count = 0;
+    uint8_t frames = 0;
+    uint8_t lost = 0;
+    bool haveNewest = false;
+    uint32_t newestOrder = 0;
+    bool haveSample = false;
+    uint32_t sampleSentMs = 0;
+    const uint32_t nowMs = millis();
+    portENTER_CRITICAL(&txLock_);
+    for (size_t i = 0; i < kMaxInFlight; ++i)
+    {
+        auto &e = inflight_[i];
+        if (!e.inUse || !e.item.expectAck || e.acked || memcmp(e.item.mac, mac, 6) != 0)
+            continue;
+        uint16_t behind = static_cast<uint16_t>(ack.msgId - e.item.msgId);
+        bool covered = (behind == 0) || (behind <= 32 && (ack.bits & (1UL << (behind - 1))));
+        if (!covered)
+            continue;
+        e.acked = true;
+        e.lost = false;
+        ++frames;
+        const uint8_t *buf = bufferPtr(e.item.bufferIndex);
+        if (e.item.pktType == PacketType::DataUnicastBatch && buf)
+        {
+            // records follow the header (and any piggybacked AppAck) as msgId(2) len(2) data
+            size_t off = kHeaderSize + ((buf[3] & kFlagAppAck) ? sizeof(AppAckPayload) : 0);
+            for (uint8_t r = 0; r < e.item.batchCount && off + kBatchRecordHeader <= e.item.len && count < kMaxAckedIds; ++r)
+            {
+                ackedIds[count++] = static_cast<uint16_t>(buf[off] | (buf[off + 1] << 8));
+                off += kBatchRecordHeader + (static_cast<size_t>(buf[off + 2]) | (static_cast<size_t>(buf[off + 3]) << 8));
+            }
+        }
+        else if (count < kMaxAckedIds)
+        {
+            ackedIds[count++] = e.item.msgId;
+        }
+        // Karn: a retransmitted frame's ack is ambiguous, so only first transmissions give RTT samples
+        if (e.retryCount == 0 && (!haveSample || static_cast<int32_t>(e.sentMs - sampleSentMs) > 0))
+        {
+            sampleSentMs = e.sentMs;
+            haveSample = true;
+        }
+        if (!haveNewest || static_cast<int32_t>(e.txOrder - newestOrder) > 0)
+            newestOrder = e.txOrder;
+        haveNewest = true;
+    }
+    if (haveNewest)
+    {
+        // Frames that went on the air before an acked one but are still unacked were lost: retry them now
+        // instead of waiting for their AppAck timeout
+        for (size_t i = 0; i < kMaxInFlight; ++i)
+        {
+            auto &e = inflight_[i];
+            if (!e.inUse || !e.item.expectAck || e.acked || e.awaitingPhy || e.lost || memcmp(e.item.mac, mac, 6) != 0)
+                continue;
+            if (static_cast<int32_t>(e.txOrder - newestOrder) < 0)
+            {
+                e.lost = true;
+                ++lost;
+            }
+        }
+    }
+    if (haveSample)
+    {
+        int idx = findPeerIndex(mac);
+        if (idx >= 0)
+            updateRtt(peers_[idx], nowMs - sampleSentMs);
+    }
+    portEXIT_CRITICAL(&txLock_);
+    if (frames > 0 || lost > 0)
+        wakeSendTask();
+    if (lost > 0)
+    {
+        ESP_LOGD(TAG, "app-ack msgId=%u bits=%08X: %u acked, %u to retransmit",
+                 ack.msgId, static_cast<unsigned>(ack.bits), frames, lost);
+    }
+    return count;
+}
+
+void EspNowBus::finishInFlight(int slot, SendStatus status, bool success)
+{
+    auto &e = inflight_[slot];
+    TxItem item = e.item;
+    portENTER_CRITICAL(&txLock_);
+    e.inUse = false;
+    e.acked = false;
+    e.awaitingPhy = false;
+    wheelUnlink(kTimerInFlightBase + static_cast<size_t>(slot));
+    portEXIT_CRITICAL(&txLock_);
+    reportSendResult(item, status);
+    if (status == SendStatus::AppAckReceived)
+        congestionOnAck(item.mac);
+    if (success)
+        recordSendSuccess(item.mac);
+    else
+        recordSendFailure(item.mac);
+    freeBuffer(item.bufferIndex);
+}
+
+bool EspNowBus::retransmit(int slot)
+{
+    auto &e = inflight_[slot];
+    e.retryCount++;
+    e.item.isRetry = true;
+    e.lost = false;
+    e.retryPending = false;
+    e.txOrder = ++txOrder_;
+    e.sentMs = millis();
+    if (!startSend(e.item))
+        return false;
+    e.awaitingPhy = true;
+    e.deadlineMs = millis() + config_.txTimeoutMs;
+    armTimer(kTimerInFlightBase + static_cast<size_t>(slot), e.deadlineMs);
+    phySlot_ = static_cast<int8_t>(slot);
+    reportSendResult(e.item, SendStatus::Retrying);
+    return true;
+}
+
+void EspNowBus::handleSendComplete(bool ok, bool timedOut)
+{
+    if (phySlot_ < 0)
+        return;
+    int slot = phySlot_;
+    phySlot_ = -1;
+    auto &e = inflight_[slot];
+    e.awaitingPhy = false;
+    if (e.acked)
+    {
+        if (!ok)
+        {
+            ESP_LOGW(TAG, "app-ack without physical ack msgId=%u", static_cast<unsigned>(e.item.msgId));
+        }
+        finishInFlight(slot, SendStatus::AppAckReceived, true);
+        return;
+    }
+    if (ok)
+    {
+        if (e.item.expectAck)
+        {
+            // Physical success; wait for app-ack to finalize
+            e.deadlineMs = millis() + peerRtoMs(e.item.mac);
+            armTimer(kTimerInFlightBase + static_cast<size_t>(slot), e.deadlineMs);
+            return;
+        }
+        finishInFlight(slot, SendStatus::SentOk, true);
+        return;
+    }
+    congestionOnLoss(e.item.mac);
+    if (e.retryCount < config_.maxRetries && isExpired(e.item, millis()))
+    {
+        finishInFlight(slot, SendStatus::Expired, false);
+        return;
+    }
+    if (e.retryCount < config_.maxRetries)
+    {
+        uint32_t delayMs = retryBackoffMs(e.retryCount);
+        if (delayMs == 0 && retransmit(slot))
+            return;
+        if (delayMs > 0)
+        {
+            // Back off without blocking the task; serviceInFlight() retransmits once the delay passes
+            e.retryPending = true;
+            e.deadlineMs = millis() + delayMs;
+            armTimer(kTimerInFlightBase + static_cast<size_t>(slot), e.deadlineMs);
+            return;
+        }
+    }
+    if (timedOut)
+    {
+        ESP_LOGW(TAG, "send timeout mac=%02X:%02X:%02X:%02X:%02X:%02X", e.item.mac[0], e.item.mac[1], e.item.mac[2], e.item.mac[3], e.item.mac[4], e.item.mac[5]);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "send failed mac=%02X:%02X:%02X:%02X:%02X:%02X", e.item.mac[0], e.item.mac[1], e.item.mac[2], e.item.mac[3], e.item.mac[4], e.item.mac[5]);
+    }
+    finishInFlight(slot, timedOut ? SendStatus::Timeout : SendStatus::SendFailed, false);
+}
+
+void EspNowBus::serviceInFlight(uint32_t nowMs)
+{
+    for (size_t i = 0; i < kMaxInFlight; ++i)
+    {
+        auto &e = inflight_[i];
+        if (!e.inUse || e.awaitingPhy)
+            continue;
+        if (e.acked)
+        {
+            finishInFlight(static_cast<int>(i), SendStatus::AppAckReceived, true);
+            continue;
+        }
+        // a retry needs the radio, so leave it for a later pass while it is busy
+        if (phySlot_ >= 0)
+            continue;
+        if (e.retryPending)
+        {
+            if (static_cast<int32_t>(nowMs - e.deadlineMs) < 0)
+                continue;
+            if (isExpired(e.item, nowMs))
+                finishInFlight(static_cast<int>(i), SendStatus::Expired, false);
+            else if (!retransmit(static_cast<int>(i)))
+                finishInFlight(static_cast<int>(i), SendStatus::SendFailed, false);
+            continue;
+        }
+        // app-ack timeout or a gap in the ack bitmap
+        if (!e.item.expectAck || (!e.lost && static_cast<int32_t>(nowMs - e.deadlineMs) < 0))
+            continue;
+        if (!e.lost)
+            backoffRto(e.item.mac);
+        congestionOnLoss(e.item.mac);
+        if (e.retryCount < config_.maxRetries && isExpired(e.item, nowMs))
+        {
+            finishInFlight(static_cast<int>(i), SendStatus::Expired, false);
+            continue;
+        }
+        if (e.retryCount < config_.maxRetries && retransmit(static_cast<int>(i)))
+            continue;
+        ESP_LOGW(TAG, "app-ack timeout mac=%02X:%02X:%02X:%02X:%02X:%02X", e.item.mac[0], e.item.mac[1], e.item.mac[2], e.item.mac[3], e.item.mac[4], e.item.mac[5]);
+        finishInFlight(static_cast<int>(i), SendStatus::AppAckTimeout, false);
+    }
+}
+
+bool EspNowBus::sendNextIfIdle()
+{
+    if (phySlot_ >= 0)
+        return false;
+    TxItem item{};
+    if (!popTx(item))
+        return false;
+    if (isExpired(item, millis()))
+    {
+        // stale data is not worth airtime; keep draining
+        reportSendResult(item, SendStatus::Expired);
+        freeBuffer(item.bufferIndex);
+        return true;
+    }
+    coalesceUnicast(item);
+    int slot = allocInFlight();
+    auto &e = inflight_[slot];
+    e.item = item;
+    e.acked = false;
+    e.lost = false;
+    e.retryPending = false;
+    e.retryCount = 0;
+    e.txOrder = ++txOrder_;
+    e.sentMs = millis();
+    e.awaitingPhy = true;
+    e.deadlineMs = millis() + config_.txTimeoutMs;
+    portENTER_CRITICAL(&txLock_);
+    e.inUse = true;
+    armTimerLocked(kTimerInFlightBase + static_cast<size_t>(slot), e.deadlineMs);
+    portEXIT_CRITICAL(&txLock_);
+    if (!startSend(e.item))
+    {
+        ESP_LOGE(TAG, "startSend failed mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 item.mac[0], item.mac[1], item.mac[2], item.mac[3], item.mac[4], item.mac[5]);
+        finishInFlight(slot, SendStatus::SendFailed, false);
+        return true;
+    }
+    phySlot_ = static_cast<int8_t>(slot);
+    return true;
+}
+
+void EspNowBus::timerReset(uint32_t nowMs)
+{
+    portENTER_CRITICAL(&txLock_);
+    for (auto &level : wheel_)
+    {
+        for (auto &head : level)
+            head = -1;
+    }
+    for (auto &occ : wheelOcc_)
+        occ = 0;
+    for (auto &t : timers_)
+        t = WheelTimer{};
+    wheelNextTick_ = nowMs;
+    portEXIT_CRITICAL(&txLock_);
+}
+
+void EspNowBus::wheelInsert(size_t id)
+{
+    WheelTimer &t = timers_[id];
+    // past-due timers run at the next tick; deadlines beyond the top level are parked at its far
+    // edge and re-placed when that slot cascades
+    int32_t delta = static_cast<int32_t>(t.expiresMs - wheelNextTick_);
+    uint32_t dist = delta < 0 ? 0 : static_cast<uint32_t>(delta);
+    uint32_t key = delta < 0 ? wheelNextTick_ : t.expiresMs;
+    constexpr uint32_t kReach = 1u << (kWheelBits * kWheelLevels);
+    if (dist >= kReach)
+    {
+        dist = kReach - 1;
+        key = wheelNextTick_ + dist;
+    }
+    size_t level = 0;
+    while (level + 1 < kWheelLevels && dist >= (1u << (kWheelBits * (level + 1))))
+        ++level;
+    size_t slot = (key >> (kWheelBits * level)) & (kWheelSlots - 1);
+    t.level = static_cast<int8_t>(level);
+    t.slot = static_cast<uint8_t>(slot);
+    t.prev = -1;
+    t.next = wheel_[level][slot];
+    if (t.next >= 0)
+        timers_[t.next].prev = static_cast<int16_t>(id);
+    wheel_[level][slot] = static_cast<int16_t>(id);
+    wheelOcc_[level] |= (1ull << slot);
+}
+
+void EspNowBus::wheelUnlink(size_t id)
+{
+    WheelTimer &t = timers_[id];
+    if (t.level < 0)
+        return;
+    if (t.prev >= 0)
+        timers_[t.prev].next = t.next;
+    else
+        wheel_[t.level][t.slot] = t.next;
+    if (t.next >= 0)
+        timers_[t.next].prev = t.prev;
+    if (wheel_[t.level][t.slot] < 0)
+        wheelOcc_[t.level] &= ~(1ull << t.slot);
+    t.level = -1;
+    t.prev = -1;
+    t.next = -1;
+}
+
+int16_t EspNowBus::wheelDetach(size_t level, size_t slot)
+{
+    int16_t head = wheel_[level][slot];
+    wheel_[level][slot] = -1;
+    wheelOcc_[level] &= ~(1ull << slot);
+    for (int16_t id = head; id >= 0; id = timers_[id].next)
+        timers_[id].level = -1;
+    return head;
+}
+
+bool EspNowBus::wheelNextEvent(uint32_t &tick) const
+{
+    // earliest tick at which any level has a slot to run (expire or cascade); O(levels) via the bitmaps
+    bool found = false;
+    uint32_t best = 0;
+    for (size_t level = 0; level < kWheelLevels; ++level)
+    {
+        uint64_t occ = wheelOcc_[level];
+        if (!occ)
+            continue;
+        const uint32_t shift = kWheelBits * level;
+        const uint32_t span = 1u << shift;
+        uint32_t base = (wheelNextTick_ + span - 1) & ~(span - 1);
+        uint32_t start = (base >> shift) & (kWheelSlots - 1);
+        if (start)
+            occ = (occ >> start) | (occ << (kWheelSlots - start));
+        uint32_t at = base + static_cast<uint32_t>(__builtin_ctzll(occ)) * span;
+        if (!found || static_cast<int32_t>(at - best) < 0)
+        {
+            best = at;
+            found = true;
+        }
+    }
+    tick = best;
+    return found;
+}
+
+void EspNowBus::armTimerLocked(size_t id, uint32_t expiresMs)
+{
+    wheelUnlink(id);
+    timers_[id].expiresMs = expiresMs;
+    wheelInsert(id);
+}
+
+void EspNowBus::armTimer(size_t id, uint32_t expiresMs)
+{
+    portENTER_CRITICAL(&txLock_);
+    armTimerLocked(id, expiresMs);
+    portEXIT_CRITICAL(&txLock_);
+}
+
+void EspNowBus::cancelTimer(size_t id)
+{
+    portENTER_CRITICAL(&txLock_);
+    wheelUnlink(id);
+    portEXIT_CRITICAL(&txLock_);
+}
+
+size_t EspNowBus::advanceTimers(uint32_t nowMs, uint8_t *fired)
+{
+    size_t count = 0;
+    portENTER_CRITICAL(&txLock_);
+    uint32_t tick = 0;
+    // jump straight between occupied slots, so a long sleep costs nothing per elapsed tick
+    while (wheelNextEvent(tick) && static_cast<int32_t>(nowMs - tick) >= 0)
+    {
+        wheelNextTick_ = tick;
+        // cascade from the top so re-placed timers land in the finer slots that run at this tick
+        for (size_t level = kWheelLevels - 1; level > 0; --level)
+        {
+            const uint32_t shift = kWheelBits * level;
+            if (tick & ((1u << shift) - 1))
+                continue;
+            int16_t id = wheelDetach(level, (tick >> shift) & (kWheelSlots - 1));
+            while (id >= 0)
+            {
+                int16_t next = timers_[id].next;
+                wheelInsert(static_cast<size_t>(id));
+                id = next;
+            }
+        }
+        int16_t id = wheelDetach(0, tick & (kWheelSlots - 1));
+        wheelNextTick_ = tick + 1;
+        while (id >= 0)
+        {
+            int16_t next = timers_[id].next;
+            if (static_cast<int32_t>(timers_[id].expiresMs - tick) <= 0)
+                fired[count++] = static_cast<uint8_t>(id);
+            else
+                wheelInsert(static_cast<size_t>(id));
+            id = next;
+        }
+    }
+    if (static_cast<int32_t>(nowMs + 1 - wheelNextTick_) > 0)
+        wheelNextTick_ = nowMs + 1;
+    portEXIT_CRITICAL(&txLock_);
+    return count;
+}
+
+bool EspNowBus::nextTimerMs(uint32_t &dueMs)
+{
+    portENTER_CRITICAL(&txLock_);
+    bool found = wheelNextEvent(dueMs);
+    portEXIT_CRITICAL(&txLock_);
+    return found;
+}
+
+void EspNowBus::onTimer(size_t id, uint32_t nowMs)
+{
+    if (id == kTimerAutoJoin)
+    {
+        lastAutoJoinMs_ = nowMs;
+        sendJoinRequest(kBroadcastMac, 0);
+        armTimer(kTimerAutoJoin, nowMs + config_.autoJoinIntervalMs);
+    }
+    else if (id == kTimerReseed)
+    {
+        reseedCounters(nowMs);
+        armTimer(kTimerReseed, lastReseedMs_ + kReseedIntervalMs);
+    }
+    else if (id == kTimerQueueTtl)
+    {
+        dropExpiredTx(nowMs);
+    }
+    else if (id == kTimerFec)
+    {
+        flushFecParity();
+    }
+    else if (id == kTimerBcastPace || id == kTimerAirtime || id == kTimerBulk)
+    {
+        // only wakes the task; sendNextIfIdle() picks up the held lanes again, serviceBulk() the session
+    }
+    else if (id < kTimerProbeBase)
+    {
+        servicePeerLiveness(id - kTimerPeerBase, nowMs);
+    }
+    else if (id < kTimerAckBase)
+    {
+        serviceCircuit(id - kTimerProbeBase, nowMs);
+    }
+    else if (id < kTimerInFlightBase)
+    {
+        flushAppAck(id - kTimerAckBase, nowMs);
+    }
+    else if (id >= kTimerNackBase)
+    {
+        flushNack(id - kTimerNackBase, nowMs);
+    }
+    // in-flight deadlines only wake the task; serviceInFlight() and the phy timeout check act on them
+}
+
+void EspNowBus::servicePeerLiveness(size_t idx, uint32_t nowMs)
+{
+    auto &p = peers_[idx];
+    const uint32_t hb = config_.heartbeatIntervalMs;
+    if (!p.inUse || hb == 0)
+        return;
+    if (p.lastSeenMs == 0)
+        p.lastSeenMs = nowMs;
+    // traffic only refreshes lastSeenMs; the stage is re-evaluated here and the timer re-armed lazily
+    uint32_t elapsed = nowMs - p.lastSeenMs;
+    if (elapsed >= hb * 3)
+    {
+        ESP_LOGW(TAG, "peer timeout drop mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 p.mac[0], p.mac[1], p.mac[2], p.mac[3], p.mac[4], p.mac[5]);
+        if (onJoinEvent_)
+            onJoinEvent_(p.mac, false, false); // treat as leave/timeout
+        removePeer(p.mac);
+        p.inUse = false;
+        p.ready = false;
+        return;
+    }
+    if (elapsed >= hb * 2)
+    {
+        if (p.heartbeatStage < 2)
+        {
+            sendJoinRequest(p.mac, 0);
+            p.heartbeatStage = 2;
+        }
+    }
+    else if (elapsed >= hb)
+    {
+        if (p.heartbeatStage < 1)
+        {
+            HeartbeatPayload ping{0};
+            enqueueCommon(Dest::Unicast, PacketType::ControlHeartbeat, p.mac, &ping, sizeof(ping), 0, Priority::Control);
+            p.heartbeatStage = 1;
+        }
+    }
+    // stage 0 -> ping at 1x, 1 -> targeted JOIN at 2x, 2 -> drop at 3x
+    armTimer(kTimerPeerBase + idx, p.lastSeenMs + hb * (p.heartbeatStage + 1u));
+}
+
+uint32_t EspNowBus::nextWaitMs(uint32_t nowMs)
+{
+    // Sleep until the earliest armed timer; anything that adds an earlier one (enqueue, AppAck,
+    // send callback, new peer) notifies the task, so there is no polling cadence.
+    uint32_t dueMs = 0;
+    if (!nextTimerMs(dueMs))
+        return kWaitForever;
+    int32_t remain = static_cast<int32_t>(dueMs - nowMs);
+    return (remain <= 0) ? 0 : static_cast<uint32_t>(remain);
+}
+
+void EspNowBus::sendTaskLoop()
+{
+    while (true)
+    {
+        uint32_t nowMs = millis();
+        uint8_t fired[kTimerCount];
+        size_t firedCount = advanceTimers(nowMs, fired);
+        for (size_t i = 0; i < firedCount; ++i)
+        {
+            onTimer(fired[i], nowMs);
+        }
+        // Retire acked entries and retry expired ones, then refill the window
+        serviceInFlight(nowMs);
+        serviceBulk(nowMs);
+        while (sendNextIfIdle())
+        {
+        }
+
+        uint32_t notifyVal = 0;
+        uint32_t waitMs = nextWaitMs(millis());
+        // round up so a deadline a fraction of a tick away does not spin
+        TickType_t ticks = (waitMs == kWaitForever) ? portMAX_DELAY : static_cast<TickType_t>((waitMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+        BaseType_t notified = xTaskNotifyWait(0, 0xFFFFFFFF, &notifyVal, ticks);
+        if (notified == pdTRUE && (notifyVal & (kNotifyTxOk | kNotifyTxFail)))
+        {
+            handleSendComplete((notifyVal & kNotifyTxOk) != 0, false);
+            continue;
+        }
+        // physical send timeout
+        if (phySlot_ >= 0 && static_cast<int32_t>(millis() - inflight_[phySlot_].deadlineMs) >= 0)
+        {
+            handleSendComplete(false, true);
+        }
+    }
+}
+
+bool EspNowBus::deriveKeys(const char *groupName)
+{
     uint8_t secret[32];
     mbedtls_sha256_context ctx;
     mbedtls_sha256_init(&ctx);
@@ -1308,18 +4200,90 @@ void EspNowBus::reseedCounters(uint32_t now)
         return;
     lastReseedMs_ = now;
     esp_fill_random(&msgCounter_, sizeof(msgCounter_));
-    esp_fill_random(&broadcastSeq_, sizeof(broadcastSeq_));
+    // broadcast seq only jumps forward, since receivers never let it move back
+    uint16_t step = 0;
+    esp_fill_random(&step, sizeof(step));
+    portENTER_CRITICAL(&txLock_);
+    broadcastSeq_ = static_cast<uint16_t>(broadcastSeq_ + 1 + (step & 0x3FFF));
+    portEXIT_CRITICAL(&txLock_);
     ESP_LOGI(TAG, "reseed counters");
 }
 
 void EspNowBus::recordSendFailure(const uint8_t mac[6])
 {
-    (void)mac;
+    if (config_.circuitBreakerFailures == 0)
+        return;
+    int idx = findPeerIndex(mac);
+    if (idx < 0)
+        return;
+    PeerInfo &p = peers_[idx];
+    if (p.failStreak < UINT8_MAX)
+        p.failStreak++;
+    if (p.circuitOpen || p.failStreak < config_.circuitBreakerFailures)
+        return;
+    p.circuitOpen = true;
+    p.circuitOpenedMs = millis();
+    p.circuitProbeMs = p.circuitOpenedMs; // probe on the next pass
+    armTimer(kTimerProbeBase + static_cast<size_t>(idx), p.circuitProbeMs);
+    ESP_LOGW(TAG, "circuit open after %u failures mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             static_cast<unsigned>(p.failStreak), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    // queued data would only burn timeouts; control frames stay so the probe can get through
+    TxItem item{};
+    while (popPeerDataTx(mac, item))
+    {
+        reportSendResult(item, SendStatus::PeerUnavailable);
+        freeBuffer(item.bufferIndex);
+    }
 }
 
 void EspNowBus::recordSendSuccess(const uint8_t mac[6])
 {
-    (void)mac;
+    int idx = findPeerIndex(mac);
+    if (idx < 0)
+        return;
+    PeerInfo &p = peers_[idx];
+    p.failStreak = 0;
+    if (p.circuitOpen)
+    {
+        p.circuitOpen = false;
+        cancelTimer(kTimerProbeBase + static_cast<size_t>(idx));
+        ESP_LOGI(TAG, "circuit closed mac=%02X:%02X:%02X:%02X:%02X:%02X",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+}
+
+void EspNowBus::serviceCircuit(size_t idx, uint32_t nowMs)
+{
+    PeerInfo &p = peers_[idx];
+    if (!p.inUse || !p.circuitOpen)
+        return;
+    // half-open: any frame heard from the peer since the circuit opened (typically the Pong to our probe) closes it
+    if (static_cast<int32_t>(p.lastSeenMs - p.circuitOpenedMs) > 0)
+    {
+        recordSendSuccess(p.mac);
+        return;
+    }
+    if (static_cast<int32_t>(nowMs - p.circuitProbeMs) < 0)
+    {
+        armTimer(kTimerProbeBase + idx, p.circuitProbeMs);
+        return;
+    }
+    p.circuitProbeMs = nowMs + config_.circuitProbeIntervalMs;
+    armTimer(kTimerProbeBase + idx, p.circuitProbeMs);
+    HeartbeatPayload ping{0};
+    enqueueCommon(Dest::Unicast, PacketType::ControlHeartbeat, p.mac, &ping, sizeof(ping), 0, Priority::Control);
+}
+
+bool EspNowBus::rejectIfCircuitOpen(const uint8_t mac[6])
+{
+    int idx = findPeerIndex(mac);
+    if (idx < 0 || !peers_[idx].circuitOpen)
+        return false;
+    if (onSendResult_)
+        onSendResult_(mac, SendStatus::PeerUnavailable);
+    ESP_LOGD(TAG, "circuit open: reject mac=%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return true;
 }
 
 int EspNowBus::findSenderIndex(const uint8_t mac[6]) const
@@ -1369,14 +4333,27 @@ int EspNowBus::ensureSender(const uint8_t mac[6])
         freeIdx = oldestIdx;
     }
     auto &s = senders_[freeIdx];
+    portENTER_CRITICAL(&txLock_); // the send task reads the NACK state
+    s = SenderWindow{};
     memcpy(s.mac, mac, 6);
     s.inUse = true;
-    s.base = 0;
-    s.window = 0;
     s.lastUsedMs = now;
+    wheelUnlink(kTimerNackBase + static_cast<size_t>(freeIdx));
+    portEXIT_CRITICAL(&txLock_);
     return freeIdx;
 }
 
+void EspNowBus::forgetSender(const uint8_t mac[6])
+{
+    int idx = findSenderIndex(mac);
+    if (idx < 0)
+        return;
+    portENTER_CRITICAL(&txLock_);
+    senders_[idx] = SenderWindow{};
+    wheelUnlink(kTimerNackBase + static_cast<size_t>(idx));
+    portEXIT_CRITICAL(&txLock_);
+}
+
 bool EspNowBus::acceptBroadcastSeq(const uint8_t mac[6], uint16_t seq)
 {
     if (config_.replayWindowBcast == 0)
@@ -1386,40 +4363,92 @@ bool EspNowBus::acceptBroadcastSeq(const uint8_t mac[6], uint16_t seq)
         return true;
     auto &s = senders_[idx];
     s.lastUsedMs = millis();
-    uint16_t window = config_.replayWindowBcast;
-    uint16_t base = s.base;
-    uint16_t dist = static_cast<uint16_t>(seq - base);
-    if (dist == 0)
+    // newest seq plus a bitmap of the ones before it, like the unicast window, so a late
+    // repair or reordered frame is judged against what was actually received
+    if (!s.seqValid)
+    {
+        s.seqValid = true;
+        s.base = seq;
+        s.window = 0;
+        return true;
+    }
+    uint16_t ahead = static_cast<uint16_t>(seq - s.base);
+    if (ahead == 0)
         return false;
-    if (dist <= window)
+    if (ahead < 0x8000)
     {
-        uint32_t bit = 1UL << (dist - 1);
-        if (s.window & bit)
-            return false;
-        s.window |= bit;
+        s.window = (ahead >= 32) ? 0 : (s.window << ahead);
+        if (ahead <= 32)
+            s.window |= 1UL << (ahead - 1);
+        s.base = seq;
+        return true;
+    }
+    uint16_t behind = static_cast<uint16_t>(s.base - seq);
+    if (behind > config_.replayWindowBcast)
+        return false; // never move base back: a restarted sender is learnt afresh via forgetSender()
+    uint32_t bit = 1UL << (behind - 1);
+    if (s.window & bit)
+        return false;
+    s.window |= bit;
+    return true;
+}
+
+bool EspNowBus::acceptUnicastMsgId(PeerInfo &peer, uint16_t msgId)
+{
+    // Retries inside the send window can arrive after newer msgIds, so remember the last 32 per peer
+    if (!peer.rxMsgValid)
+    {
+        peer.rxMsgValid = true;
+        peer.rxMsgBase = msgId;
+        peer.rxMsgWindow = 0;
         return true;
     }
-    uint16_t shift = dist - 1;
-    if (shift >= 32)
+    uint16_t ahead = static_cast<uint16_t>(msgId - peer.rxMsgBase);
+    if (ahead == 0)
+        return false;
+    if (ahead < 0x8000)
     {
-        s.window = 0;
+        peer.rxMsgWindow = (ahead >= 32) ? 0 : (peer.rxMsgWindow << ahead);
+        if (ahead <= 32)
+            peer.rxMsgWindow |= 1UL << (ahead - 1);
+        peer.rxMsgBase = msgId;
+        return true;
     }
-    else
+    uint16_t behind = static_cast<uint16_t>(peer.rxMsgBase - msgId);
+    if (behind > kReplayWindow)
     {
-        s.window <<= shift;
+        // far behind (sender reseeded or rebooted): resync instead of dropping everything
+        peer.rxMsgBase = msgId;
+        peer.rxMsgWindow = 0;
+        return true;
     }
-    s.window |= 1UL;
-    s.base = seq;
+    uint32_t bit = 1UL << (behind - 1);
+    if (peer.rxMsgWindow & bit)
+        return false;
+    peer.rxMsgWindow |= bit;
     return true;
 }
 
-bool EspNowBus::acceptAppAck(PeerInfo &peer, uint16_t msgId)
+bool EspNowBus::acceptAppAck(PeerInfo &peer, uint16_t msgId, bool cumulative)
 {
-    // Simple check: accept if not equal to last seen; update last
-    if (peer.lastAppAckId == msgId)
+    if (!cumulative)
     {
-        return false;
+        // single-msgId ack: accept if not equal to last seen
+        if (peer.appAckValid && peer.lastAppAckId == msgId)
+            return false;
+        peer.appAckValid = true;
+        peer.lastAppAckId = msgId;
+        return true;
+    }
+    // A cumulative ack's bitmap covers everything an older one could say, so drop acks that go
+    // backwards within the window. Far behind means the peer reseeded; resync like the msgId window.
+    if (peer.appAckValid)
+    {
+        uint16_t behind = static_cast<uint16_t>(peer.lastAppAckId - msgId);
+        if (behind != 0 && behind <= kReplayWindow)
+            return false;
     }
+    peer.appAckValid = true;
     peer.lastAppAckId = msgId;
     return true;
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <Arduino.h>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <esp_now.h>
 #include <esp_idf_version.h>
@@ -14,6 +16,14 @@
 class EspNowBus
 {
 public:
+    // Loss-driven AIMD window for frames awaiting an AppAck
+    enum class CongestionMode : uint8_t
+    {
+        Off = 0,     // fixed sendWindow
+        PerPeer = 1, // each peer's window grows/halves on its own AppAcks and losses
+        Group = 2,   // one window caps AppAck-awaiting frames across all peers
+    };
+
     struct Config
     {
         const char *groupName; // Required
@@ -25,16 +35,39 @@ public:
         // Radio
         int8_t channel = -1;                           // -1 = auto (groupName hash), otherwise clip to 1-13
         wifi_phy_rate_t phyRate = WIFI_PHY_RATE_11M_L; // default 11M; adjust if you need higher throughput
-
-        uint16_t maxQueueLength = 16;
+        uint16_t broadcastJitterMs = 0;                // random 0..N ms added to the airtime gap after each broadcast/JOIN frame
+        uint8_t broadcastHistory = 0;                  // reliable broadcast: recent DataBroadcast frames kept for NACK repair (0 = off, max 32)
+        uint16_t nackDelayMs = 20;                     // receivers NACK a broadcast gap after 1-2x this; a frame is repaired at most once per this
+        uint8_t fecBlockSize = 0;                      // broadcast FEC: one XOR parity frame per this many DataBroadcast frames; also enables decoding (0 = off, max 16)
+        uint16_t airtimeBudgetMsPerSec = 0;            // airtime this node may use per second, all destinations (0 = unlimited)
+        uint16_t peerAirtimeBudgetMsPerSec = 0;        // airtime per second for any single destination (0 = unlimited)
+
+        uint16_t maxQueueLength = 16;   // full-size (maxPayloadBytes) buffers
+        uint16_t smallBufferCount = 8;  // extra 64-byte buffers (AppAck, heartbeat, short frames)
+        uint16_t mediumBufferCount = 0; // extra 256-byte buffers
+        uint16_t maxQueuePerPeer = 0; // per-destination cap (0 = maxQueueLength)
         uint16_t maxPayloadBytes = 1470;
         uint32_t sendTimeoutMs = 50;
         uint8_t maxRetries = 1;
-        uint16_t retryDelayMs = 0;
-        uint32_t txTimeoutMs = 120;
+        uint16_t retryDelayMs = 0;       // first retry delay after a send failure (0 = immediate); doubles per attempt with jitter
+        uint16_t retryDelayMaxMs = 1000; // backoff ceiling
+        uint32_t txTimeoutMs = 120; // physical send timeout; also the AppAck timeout until a peer's RTT is measured
+        uint16_t rtoMinMs = 5;      // floor for the per-peer AppAck timeout derived from measured RTT
+        uint32_t rtoMaxMs = 2000;   // ceiling (also caps backoff after timeouts)
+        uint8_t sendWindow = 1; // unicast frames awaiting AppAck per peer (1 = stop-and-wait, max kMaxInFlight)
+        CongestionMode congestionControl = CongestionMode::Off; // AIMD congestion window on top of sendWindow
+        bool aggregateUnicast = false; // pack queued DataUnicast frames to the same peer into one container frame
+        uint16_t appAckDelayMs = 0; // hold AppAcks to piggyback on reverse DataUnicast (0 = send at once; needs useEncryption)
+        uint32_t maxMessageBytes = 16384;   // largest sendLarge() message, sent or reassembled
+        uint8_t reassemblySlots = 0;        // preallocated maxMessageBytes buffers for incoming sendLarge() (0 = off, max 4)
+        uint32_t reassemblyTimeoutMs = 5000; // an idle partial message gives up its slot after this
+        uint8_t bulkWindow = 0;              // startBulk() chunks in flight; receivers buffer as many (0 = off, max 32)
+        uint32_t bulkIdleTimeoutMs = 30000;  // a bulk session without progress fails (also how long a dropped peer may take to rejoin)
 
         uint32_t autoJoinIntervalMs = 30000;  // 0=disabled, otherwise periodic JOIN
         uint32_t heartbeatIntervalMs = 10000; // ping cadence; 2x -> targeted join, 3x -> drop
+        uint8_t circuitBreakerFailures = 0;   // consecutive failed sends that open a peer's circuit (0 = off)
+        uint32_t circuitProbeIntervalMs = 1000; // heartbeat probe cadence while a circuit is open
 
         int8_t taskCore = ARDUINO_RUNNING_CORE; // -1 = unpinned, 0/1 = pinned core
         UBaseType_t taskPriority = 3;
@@ -49,12 +82,18 @@ public:
     static constexpr uint16_t kMaxPayloadLegacy = 250;
     static constexpr uint8_t kAuthTagLen = 16;
     static constexpr size_t kHeaderSize = 6; // magic(1)+ver(1)+type(1)+flags(1)+id(2: msgId or seq)
+    static constexpr uint8_t kFlagRetry = 0x01;  // header flags: retransmission
+    static constexpr uint8_t kFlagAppAck = 0x02; // header flags: DataUnicast carries a piggybacked AppAck before the payload
+    static constexpr uint8_t kFlagReliable = 0x04; // header flags: DataBroadcast carries dataSeq(2) after groupId and can be NACKed
+    static constexpr uint8_t kFlagFec = 0x08;      // header flags: DataBroadcast carries dataSeq(2) + FEC block position(1) after groupId
     static constexpr uint16_t kReplayWindow = 32;
     static constexpr uint8_t kNonceLen = 8;
     static constexpr uint16_t kNonceWindow = 128;
     static constexpr uint32_t kReseedIntervalMs = 60 * 60 * 1000; // periodic key reseed (if desired)
     static constexpr uint8_t kBroadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     static constexpr uint32_t kLeaveWaitMs = 30; // short wait after sending leave
+    static constexpr uint8_t kMaxInFlight = 16;  // in-flight table size shared by all peers
+    static constexpr size_t kBatchRecordHeader = 4; // container record: msgId(2) + len(2)
 
     enum PacketType : uint8_t
     {
@@ -65,6 +104,12 @@ public:
         ControlHeartbeat = 5,
         ControlAppAck = 6,
         ControlLeave = 7,
+        DataUnicastBatch = 8, // container of several DataUnicast messages: [msgId(2)][len(2)][data] records
+        DataFragment = 9,     // one piece of a sendLarge() message: FragmentHeader + bytes
+        DataBulk = 10,        // one chunk of a startBulk() session: BulkHeader + bytes
+        ControlBulkAck = 11,  // receiver state of a bulk session: BulkAckPayload
+        ControlNack = 12,     // broadcast: reliable-broadcast frames missing from one sender, NackPayload
+        DataFecParity = 13,   // broadcast: XOR of one FEC block of DataBroadcast payloads, FecParityHeader + bytes
     };
 
 #pragma pack(push, 1)
@@ -84,18 +129,78 @@ public:
 
     struct AppAckPayload
     {
-        uint16_t msgId;
+        uint16_t msgId; // newest msgId received from the peer
+        uint32_t bits;  // bit n = msgId (msgId - 1 - n) also received
     };
 
     struct HeartbeatPayload
     {
         uint8_t kind; // 0=Ping, 1=Pong
     };
+
+    struct FragmentHeader
+    {
+        uint16_t messageId; // per sender, shared by every fragment of one message
+        uint16_t fragSize;  // bytes per fragment (all but the last are full)
+        uint32_t totalLen;
+        uint32_t offset;    // multiple of fragSize
+    };
+
+    struct BulkHeader
+    {
+        uint32_t transferId; // random per session
+        uint32_t totalLen;
+        uint32_t index;      // chunk number; offset = index * chunkSize
+        uint16_t chunkSize;
+        uint8_t flags;       // kBulkPoll
+    };
+
+    struct BulkAckPayload
+    {
+        uint32_t transferId;
+        uint32_t base;  // every chunk below is delivered
+        uint32_t bits;  // bit n = chunk (base + 1 + n) held for reordering
+        uint8_t flags;  // kBulkAckReset
+    };
+
+    struct NackPayload
+    {
+        uint8_t target[6]; // sender of the missing frames
+        uint16_t base;     // newest dataSeq seen from target
+        uint32_t missing;  // bit n = dataSeq (base - 1 - n) missing
+    };
+
+    struct FecParityHeader
+    {
+        uint16_t first;  // dataSeq of the block's first frame
+        uint8_t count;   // frames in the block (first .. first + count - 1)
+        uint16_t lenXor; // XOR of the members' payload lengths
+    };
 #pragma pack(pop)
     static_assert(sizeof(JoinReqPayload) == kNonceLen * 2 + 6, "JoinReqPayload size");
     static_assert(sizeof(JoinAckPayload) == kNonceLen * 2 + 6, "JoinAckPayload size");
-    static_assert(sizeof(AppAckPayload) == 2, "AppAckPayload size");
+    static_assert(sizeof(AppAckPayload) == 6, "AppAckPayload size");
+    static constexpr size_t kAppAckLegacyLen = 2; // msgId only (single-frame ack from older firmware)
     static_assert(sizeof(HeartbeatPayload) == 1, "HeartbeatPayload size");
+    static_assert(sizeof(FragmentHeader) == 12, "FragmentHeader size");
+    static_assert(sizeof(BulkHeader) == 15, "BulkHeader size");
+    static_assert(sizeof(BulkAckPayload) == 13, "BulkAckPayload size");
+    static_assert(sizeof(NackPayload) == 12, "NackPayload size");
+    static_assert(sizeof(FecParityHeader) == 5, "FecParityHeader size");
+    static constexpr size_t kFecDataExt = 3; // dataSeq(2) + position(1) in an FEC-protected DataBroadcast
+    static constexpr uint8_t kBulkPoll = 0x01;      // BulkHeader flags: answer with a BulkAck at once
+    static constexpr uint8_t kBulkAckReset = 0x01;  // BulkAck flags: no state for this session, start again at chunk 0
+
+    // Reported to onBulkProgress on the sending node
+    enum class BulkEvent : uint8_t
+    {
+        Progress,  // the receiver confirmed more data (also after a restart from 0)
+        Paused,    // peer left or its circuit opened; the session waits for it
+        Resumed,   // peer is back; sending continues from the last confirmed chunk
+        Completed,
+        Failed,    // no progress for bulkIdleTimeoutMs, or the source returned short
+        Cancelled,
+    };
 
     enum SendStatus : uint8_t
     {
@@ -108,13 +213,82 @@ public:
         TooLarge,
         Retrying,
         AppAckTimeout,
-        AppAckReceived
+        AppAckReceived,
+        Expired,
+        PeerUnavailable,
+        RateLimited
+    };
+
+    // Strict-priority send classes; a queued Control frame always goes before Interactive, then Bulk
+    enum class Priority : uint8_t
+    {
+        Control = 0, // AppAck / heartbeat / JOIN use this class
+        Interactive = 1,
+        Bulk = 2,
+    };
+    static constexpr size_t kPriorityCount = 3;
+
+    struct SendOptions
+    {
+        uint32_t timeoutMs = kUseDefault;
+        Priority priority = Priority::Interactive;
+        uint16_t coalesceKey = 0; // non-zero: replace a still-queued frame with the same key and destination
+        uint32_t ttlMs = 0;       // non-zero: drop with Expired if not on air (or still retrying) after this long
+    };
+
+    // One piece of a scatter-gather payload; segments are laid out back to back in the frame
+    struct SendSegment
+    {
+        const void *data;
+        size_t len;
+    };
+
+    // Zero-copy send: reserve() hands out a writable span inside a pool buffer, right after the bus header;
+    // commit() fills in the header/HMAC and queues it, cancel() gives the buffer back.
+    // Move-only: a copy would let the same buffer be committed or cancelled twice.
+    struct SendReservation
+    {
+        uint8_t *data = nullptr; // write the payload here
+        size_t capacity = 0;     // bytes available at data
+
+        SendReservation() = default;
+        SendReservation(const SendReservation &) = delete;
+        SendReservation &operator=(const SendReservation &) = delete;
+        SendReservation(SendReservation &&other) noexcept { *this = static_cast<SendReservation &&>(other); }
+        SendReservation &operator=(SendReservation &&other) noexcept
+        {
+            if (this != &other)
+            {
+                data = other.data;
+                capacity = other.capacity;
+                bufferIndex = other.bufferIndex;
+                broadcast = other.broadcast;
+                memcpy(mac, other.mac, sizeof(mac));
+                opts = other.opts;
+                other.data = nullptr;
+                other.capacity = 0;
+                other.bufferIndex = -1;
+            }
+            return *this;
+        }
+
+    private:
+        friend class EspNowBus;
+        int16_t bufferIndex = -1;
+        bool broadcast = false;
+        uint8_t mac[6]{};
+        SendOptions opts{};
     };
 
     using ReceiveCallback = void (*)(const uint8_t *mac, const uint8_t *data, size_t len, bool wasRetry, bool isBroadcast);
     using SendResultCallback = void (*)(const uint8_t *mac, SendStatus status);
     using AppAckCallback = void (*)(const uint8_t *mac, uint16_t msgId);
     using JoinEventCallback = void (*)(const uint8_t mac[6], bool accepted, bool isAck);
+    // Bulk source: copy exactly len bytes at offset into dst and return len (runs on the send task; may be asked again after a loss)
+    using BulkSourceCallback = size_t (*)(uint32_t offset, uint8_t *dst, size_t len);
+    using BulkProgressCallback = void (*)(const uint8_t *mac, BulkEvent event, uint32_t doneBytes, uint32_t totalBytes);
+    // In order and exactly once per session; offset 0 again means the sender restarted the transfer
+    using BulkReceiveCallback = void (*)(const uint8_t *mac, uint32_t offset, const uint8_t *data, size_t len, uint32_t totalBytes);
 
     bool begin(const Config &cfg);
 
@@ -127,11 +301,39 @@ public:
     bool sendTo(const uint8_t mac[6], const void *data, size_t len, uint32_t timeoutMs = kUseDefault);
     bool sendToAllPeers(const void *data, size_t len, uint32_t timeoutMs = kUseDefault);
     bool broadcast(const void *data, size_t len, uint32_t timeoutMs = kUseDefault);
+    bool sendTo(const uint8_t mac[6], const void *data, size_t len, const SendOptions &opts);
+    bool sendToAllPeers(const void *data, size_t len, const SendOptions &opts);
+    bool broadcast(const void *data, size_t len, const SendOptions &opts);
+
+    // Scatter-gather: the segments are copied straight into the pool buffer, so a layered protocol can pass
+    // its header and payload separately without staging them in a temporary buffer first.
+    bool sendTo(const uint8_t mac[6], const SendSegment *segments, size_t count, uint32_t timeoutMs = kUseDefault);
+    bool sendTo(const uint8_t mac[6], const SendSegment *segments, size_t count, const SendOptions &opts);
+    bool broadcast(const SendSegment *segments, size_t count, uint32_t timeoutMs = kUseDefault);
+    bool broadcast(const SendSegment *segments, size_t count, const SendOptions &opts);
+
+    // Messages up to Config.maxMessageBytes, split into unicast fragments; the receiver (reassemblySlots > 0)
+    // delivers one onReceive. Each fragment is acked and retried on its own; timeoutMs applies per fragment.
+    bool sendLarge(const uint8_t mac[6], const void *data, size_t len, uint32_t timeoutMs = kUseDefault);
+    bool sendLarge(const uint8_t mac[6], const void *data, size_t len, const SendOptions &opts);
+
+    // One outgoing bulk session at a time (Config.bulkWindow > 0 on both nodes): selective-repeat chunks
+    // pulled from source, acknowledged a few times per window. Survives the peer dropping and rejoining.
+    bool startBulk(const uint8_t mac[6], uint32_t totalLen, BulkSourceCallback source);
+    void cancelBulk();
+    bool bulkActive() const;
+
+    bool reserve(const uint8_t mac[6], size_t maxLen, SendReservation &out, uint32_t timeoutMs = kUseDefault);
+    bool reserve(const uint8_t mac[6], size_t maxLen, SendReservation &out, const SendOptions &opts);
+    bool commit(SendReservation &res, size_t len);
+    void cancel(SendReservation &res);
 
     void onReceive(ReceiveCallback cb);
     void onSendResult(SendResultCallback cb);
     void onAppAck(AppAckCallback cb);
     void onJoinEvent(JoinEventCallback cb);
+    void onBulkProgress(BulkProgressCallback cb);
+    void onBulkReceive(BulkReceiveCallback cb);
     bool addPeer(const uint8_t mac[6]);
     bool removePeer(const uint8_t mac[6]);
     bool hasPeer(const uint8_t mac[6]) const;
@@ -143,6 +345,8 @@ public:
     // Queue introspection
     uint16_t sendQueueFree() const;
     uint16_t sendQueueSize() const;
+    uint16_t sendQueueFree(const uint8_t mac[6]) const;
+    uint16_t sendQueueSize(const uint8_t mac[6]) const;
 
     // Pair management (plain, no auth yet)
     bool initPeers(const uint8_t peers[][6], size_t count);
@@ -162,12 +366,58 @@ private:
         uint16_t seq;
         Dest dest;
         PacketType pktType;
+        Priority priority;
         bool isRetry;
         uint8_t mac[6];
 
         // App-level ACK tracking
         bool expectAck = false;
-        uint32_t appAckDeadlineMs = 0;
+        uint8_t batchCount = 1; // user messages carried (>1 for a DataUnicastBatch container)
+        bool shared = false;    // payload buffer shared by a sendToAllPeers fan-out; header written per send
+        bool repair = false;    // reliable-broadcast retransmission from the history (no onSendResult)
+        uint16_t coalesceKey = 0;
+        bool hasExpiry = false;
+        uint32_t expiresMs = 0; // millis() after which the frame is dropped instead of (re)sent
+    };
+
+    // Queued frames live in per-destination lanes, linked through a fixed node pool
+    struct TxNode
+    {
+        TxItem item;
+        int16_t next;
+    };
+
+    // Airtime token bucket in microseconds; a bucket may go into debt by one frame and blocks data until refilled
+    struct AirBucket
+    {
+        int32_t tokensUs = 0;
+        uint32_t stampUs = 0;
+        bool primed = false; // starts full on first use
+    };
+
+    struct TxLane
+    {
+        uint8_t mac[6]{};
+        bool inUse = false;
+        int16_t head[kPriorityCount] = {-1, -1, -1}; // one FIFO per priority class
+        int16_t tail[kPriorityCount] = {-1, -1, -1};
+        uint16_t count = 0;                      // all classes
+        int32_t deficit[kPriorityCount] = {};    // deficit-round-robin credit in bytes
+        AirBucket air;                           // peerAirtimeBudgetMsPerSec; the lane outlives its queue while in debt
+    };
+
+    struct InFlight
+    {
+        TxItem item{};
+        bool inUse = false;
+        bool awaitingPhy = false; // esp_now_send issued, send callback pending
+        bool acked = false;       // AppAck matched (set from the receive callback)
+        bool lost = false;        // a later frame to the same peer was acked first; retransmit without waiting
+        bool retryPending = false; // send failed; retransmit once deadlineMs (the backoff) passes
+        uint8_t retryCount = 0;
+        uint32_t txOrder = 0;    // bumped on every transmission, orders frames on the air
+        uint32_t deadlineMs = 0; // physical deadline while awaitingPhy, AppAck deadline afterwards
+        uint32_t sentMs = 0;     // last transmission, for RTT samples
     };
 
     struct PeerInfo
@@ -175,17 +425,38 @@ private:
         uint8_t mac[6];
         bool inUse = false;
         bool ready = false; // externally visible/sendable peer
-        uint16_t lastMsgId = 0;
+        bool rxMsgValid = false;  // unicast duplicate window: newest msgId + bitmap of the 32 before it
+        uint16_t rxMsgBase = 0;
+        uint32_t rxMsgWindow = 0; // bit n = msgId (rxMsgBase - 1 - n) received
         uint16_t lastBroadcastBase = 0;
         uint32_t bcastWindow = 0; // bit0 = base+1 ... bit32 = base+32
 
         uint8_t lastNonceB[kNonceLen]{};
         bool nonceValid = false;
 
-        uint16_t lastAppAckId = 0;
+        bool appAckValid = false;
+        uint16_t lastAppAckId = 0; // newest AppAck base seen from this peer
+
+        bool ackPending = false; // AppAck held back for piggybacking (guarded by txLock_)
+        uint32_t ackDueMs = 0;   // send standalone once this passes
+
+        bool rttValid = false; // Jacobson/Karels estimator over AppAck round trips (guarded by txLock_)
+        uint32_t srtt8 = 0;    // smoothed RTT x8 (ms)
+        uint32_t rttvar4 = 0;  // RTT mean deviation x4 (ms)
+        uint8_t rtoBackoff = 0; // doublings after AppAck timeouts, cleared by the next sample
+
+        uint16_t cwndQ8 = 256;   // AIMD congestion window x256 (CongestionMode::PerPeer, send task only)
+        uint32_t cwndCutMs = 0;  // last halving; further losses within one RTO count as the same event
 
         uint32_t lastSeenMs = 0;    // heartbeat tracking
         uint8_t heartbeatStage = 0; // 0=normal,1=ping sent,2=targeted join sent
+
+        uint8_t failStreak = 0;       // consecutive failed sends (circuit breaker, send task only)
+        bool circuitOpen = false;     // data to this peer fails fast with PeerUnavailable
+        uint32_t circuitOpenedMs = 0; // anything heard after this closes the circuit
+        uint32_t circuitProbeMs = 0;  // next heartbeat probe while open
+
+        bool fragRejectLogged = false; // sendLarge() from this peer that we can never reassemble was reported
     };
 
     Config config_{};
@@ -193,6 +464,8 @@ private:
     SendResultCallback onSendResult_ = nullptr;
     AppAckCallback onAppAck_ = nullptr;
     JoinEventCallback onJoinEvent_ = nullptr;
+    BulkProgressCallback onBulkProgress_ = nullptr;
+    BulkReceiveCallback onBulkReceive_ = nullptr;
     struct DerivedKeys
     {
         uint8_t pmk[16]{};      // Primary Master Key for ESP-NOW encryption
@@ -202,21 +475,50 @@ private:
         uint32_t groupId = 0;   // Public group id
     } derived_{};
 
-    QueueHandle_t sendQueue_ = nullptr;
+    // Payload pool split into size classes, all carved out of one allocation in begin()
+    static constexpr size_t kBufferClassCount = 3; // 64 B, 256 B, maxPayloadBytes
+    static constexpr uint16_t kSmallBufferBytes = 64;
+    static constexpr uint16_t kMediumBufferBytes = 256;
+    struct BufferClass
+    {
+        uint16_t size = 0;
+        uint16_t first = 0; // first buffer index of the class
+        uint16_t count = 0;
+        size_t offset = 0;                 // byte offset in payloadPool_
+        SemaphoreHandle_t space = nullptr; // counts free buffers of the class
+    };
+    BufferClass bufClasses_[kBufferClassCount];
+    TxNode *txNodes_ = nullptr;
+    int16_t txFreeNode_ = -1;
+    uint16_t txQueued_ = 0;
+    // sendToAllPeers descriptors come from kFanoutNodes spare nodes on top of one per buffer; a fan-out
+    // reserves all of its descriptors up front so it never reaches only some peers (guarded by txLock_)
+    uint16_t fanoutNodesFree_ = 0;
     TaskHandle_t sendTask_ = nullptr;
     TaskHandle_t selfTaskHandle_ = nullptr; // for notifications
 
     uint8_t *payloadPool_ = nullptr;
-    bool *bufferUsed_ = nullptr;
+    std::atomic<uint32_t> *bufferFree_ = nullptr; // one bit per buffer, 1 = free; claimed with CAS
+    std::atomic<uint8_t> *bufferRefs_ = nullptr;  // descriptors still holding each buffer
+    size_t bufferWords_ = 0;
     size_t poolCount_ = 0;
 
-    TxItem currentTx_{};
-    bool txInFlight_ = false;
-    uint8_t retryCount_ = 0;
-    uint32_t txDeadlineMs_ = 0;
+    // Send window: one ESP-NOW send outstanding at a time (phySlot_), while up to
+    // sendWindow unicast frames per peer wait for their AppAck in inflight_.
+    InFlight inflight_[kMaxInFlight];
+    int8_t phySlot_ = -1;
+    uint32_t txOrder_ = 0;
+    bool txExpiryPending_ = false; // a queued frame carries a TTL; txNextExpiryMs_ is the earliest
+    uint32_t txNextExpiryMs_ = 0;
+    portMUX_TYPE txLock_ = portMUX_INITIALIZER_UNLOCKED; // guards lanes_, txNodes_ and inflight_ state
     uint32_t lastJoinReqMs_ = 0;
     uint32_t lastAutoJoinMs_ = 0;
 
+    static constexpr uint32_t kNotifyTxOk = 1;   // ESP-NOW send callback: success
+    static constexpr uint32_t kNotifyTxFail = 2; // ESP-NOW send callback: failure
+    static constexpr uint32_t kNotifyWake = 4;   // queue/AppAck/peer-table activity
+    static constexpr uint32_t kWaitForever = UINT32_MAX; // nextWaitMs(): nothing scheduled
+
     static constexpr uint8_t kMagic = 0xEB;
     static constexpr uint8_t kVersion = 1;
 
@@ -224,18 +526,182 @@ private:
     uint16_t broadcastSeq_ = 0;
 
     static constexpr size_t kMaxPeers = 20;
+    static constexpr size_t kFanoutNodes = 2 * kMaxPeers; // sendToAllPeers descriptors: two full fan-outs may wait at once
     PeerInfo peers_[kMaxPeers];
+    static constexpr size_t kMaxLanes = kMaxPeers + 1; // every peer + broadcast
+    TxLane lanes_[kMaxLanes];
+    uint8_t laneCursor_[kPriorityCount] = {};
+    bool laneGranted_[kPriorityCount] = {}; // quantum already added for the lane at laneCursor_
+    // Reassembly for DataFragment; touched only from the receive callback
+    static constexpr size_t kMaxReassemblySlots = 4;
+    static constexpr size_t kMaxFragments = 256;
+    struct Reassembly
+    {
+        uint8_t mac[6]{};
+        bool inUse = false;
+        bool complete = false; // delivered; kept so late retransmissions are recognised
+        uint16_t messageId = 0;
+        uint16_t fragSize = 0;
+        uint16_t fragCount = 0;
+        uint16_t received = 0;
+        uint32_t totalLen = 0;
+        uint32_t lastMs = 0;
+        uint32_t have[kMaxFragments / 32] = {};
+        uint8_t *data = nullptr; // slice of reassemblyPool_
+    };
+    Reassembly reassembly_[kMaxReassemblySlots];
+    uint8_t *reassemblyPool_ = nullptr;
+    uint16_t largeMsgId_ = 0;
+
+    // Bulk session. Bitmaps cover the window relative to base, so acks cost O(1) however long the
+    // transfer is. The sender side is guarded by txLock_ (acks arrive on the receive callback).
+    static constexpr uint8_t kMaxBulkWindow = 32;
+    static constexpr uint16_t kBulkQueueDepth = 2; // chunks kept queued ahead of the radio
+    struct BulkTx
+    {
+        bool active = false;
+        bool paused = false;
+        bool progressed = false; // base moved since the last report
+        uint8_t mac[6]{};
+        uint32_t transferId = 0;
+        uint32_t totalLen = 0;
+        uint16_t chunkSize = 0;
+        uint32_t chunkCount = 0;
+        uint32_t base = 0;   // every chunk below is confirmed
+        uint32_t next = 0;   // first chunk never sent
+        uint32_t acked = 0;  // bit n = chunk (base + n) confirmed out of order
+        uint32_t resend = 0; // bit n = chunk (base + n) to retransmit
+        uint32_t retxd = 0;  // bit n = chunk (base + n) retransmitted since the last timeout
+        uint8_t timeouts = 0;
+        uint32_t rtoMs = 0;      // current retransmit timeout, refreshed by serviceBulk()
+        uint32_t deadlineMs = 0; // no ack by then: poke the oldest chunk
+        uint32_t progressMs = 0;
+        BulkSourceCallback source = nullptr;
+    };
+    BulkTx bulkTx_;
+    // receiving side, touched only from the receive callback
+    struct BulkRx
+    {
+        bool active = false;
+        bool complete = false;
+        bool gapAcked = false; // the current gap has been reported once
+        uint8_t mac[6]{};
+        uint32_t transferId = 0;
+        uint32_t totalLen = 0;
+        uint16_t chunkSize = 0;
+        uint32_t chunkCount = 0;
+        uint32_t base = 0;     // next chunk to deliver
+        uint32_t have = 0;     // bit n = chunk (base + 1 + n) waiting in bulkRxPool_
+        uint8_t sinceAck = 0;
+        uint32_t lastMs = 0;
+    };
+    BulkRx bulkRx_;
+    uint8_t *bulkRxPool_ = nullptr; // bulkWindow chunks, slot = index % bulkWindow
+
     static constexpr size_t kMaxSenders = 16;
     struct SenderWindow
     {
         uint8_t mac[6]{};
         bool inUse = false;
-        uint16_t base = 0;
-        uint32_t window = 0;
+        bool seqValid = false;
+        uint16_t base = 0;   // newest seq accepted
+        uint32_t window = 0; // bit n = seq (base - 1 - n) accepted
         uint32_t lastUsedMs = 0;
+
+        // reliable broadcast gap tracking (guarded by txLock_; the send task sends the NACKs)
+        bool relValid = false;
+        uint16_t relBase = 0;     // newest dataSeq seen
+        uint32_t relMissing = 0;  // bit n = dataSeq (relBase - 1 - n) still wanted
+        uint8_t nackTries = 0;
+        bool nackArmed = false;
     };
     SenderWindow senders_[kMaxSenders];
 
+    // Reliable broadcast history: the frame with dataSeq d sits in slot d % broadcastHistory and holds a
+    // reference on its pool buffer, so a repair is re-queued without copying (guarded by txLock_)
+    static constexpr uint8_t kMaxBroadcastHistory = 32;
+    static constexpr uint8_t kNackRetries = 3;
+    struct BcastHistory
+    {
+        bool valid = false;
+        uint16_t dataSeq = 0;
+        uint16_t bufferIndex = 0;
+        uint16_t len = 0;
+        uint32_t repairedMs = 0;
+        bool repaired = false;
+    };
+    BcastHistory bcastHistory_[kMaxBroadcastHistory];
+    uint16_t bcastDataSeq_ = 0;
+
+    // Broadcast FEC (XOR parity, one lost frame per block). The sender's running parity is touched only
+    // by the send task, the receiving blocks only by the receive callback.
+    static constexpr uint8_t kMaxFecBlock = 16;
+    static constexpr size_t kFecRxSlots = 2;     // senders decoded at the same time
+    static constexpr uint32_t kFecFlushMs = 100; // a partial block sends its parity after this
+    struct FecRx
+    {
+        uint8_t mac[6]{};
+        bool inUse = false;
+        bool parity = false; // the block's parity has been folded in
+        bool done = false;   // every member delivered or rebuilt
+        uint16_t first = 0;
+        uint8_t count = 0;   // known once the parity is in
+        uint16_t have = 0;   // bit n = frame (first + n) received or rebuilt
+        uint16_t lenXor = 0;
+        uint16_t span = 0;   // bytes of acc in use
+        uint32_t lastMs = 0;
+        uint8_t *acc = nullptr; // XOR of everything received for the block, slice of fecPool_
+    };
+    FecRx fecRx_[kFecRxSlots];
+    uint8_t *fecPool_ = nullptr;  // receive slots
+    int16_t fecTxBufIdx_ = -1;    // pool buffer the open block's parity accumulates in (-1: block unprotected)
+    uint16_t fecTxFirst_ = 0;
+    uint8_t fecTxCount_ = 0;
+    uint16_t fecTxLenXor_ = 0;
+    uint16_t fecTxSpan_ = 0;
+
+    // Hierarchical timer wheel holding every deadline the send task sleeps on: 1 ms ticks, 4 levels of
+    // 64 slots (~4.6 h reach, farther deadlines are re-placed on cascade). Arm/cancel are O(1) and a pass
+    // touches only expiring slots, so timer work does not grow with the peer table. Guarded by txLock_.
+    static constexpr size_t kWheelBits = 6;
+    static constexpr size_t kWheelSlots = 1u << kWheelBits;
+    static constexpr size_t kWheelLevels = 4;
+    static constexpr size_t kTimerAutoJoin = 0;
+    static constexpr size_t kTimerReseed = 1;
+    static constexpr size_t kTimerQueueTtl = 2;                              // earliest queued TTL
+    static constexpr size_t kTimerBcastPace = 3;                             // broadcast airtime gap
+    static constexpr size_t kTimerAirtime = 4;                               // earliest airtime bucket refill
+    static constexpr size_t kTimerBulk = 5;                                  // bulk retransmit / idle deadline
+    static constexpr size_t kTimerFec = 6;                                   // flush a partial FEC block
+    static constexpr size_t kTimerPeerBase = 7;                              // heartbeat stage, per peer
+    static constexpr size_t kTimerProbeBase = kTimerPeerBase + kMaxPeers;    // circuit probe, per peer
+    static constexpr size_t kTimerAckBase = kTimerProbeBase + kMaxPeers;     // held AppAck, per peer
+    static constexpr size_t kTimerInFlightBase = kTimerAckBase + kMaxPeers;  // send/AppAck/retry deadline, per slot
+    static constexpr size_t kTimerNackBase = kTimerInFlightBase + kMaxInFlight; // broadcast NACK hold-off, per sender
+    static constexpr size_t kTimerCount = kTimerNackBase + kMaxSenders;
+    static_assert(kTimerCount <= UINT8_MAX, "timer ids are reported as uint8_t");
+    struct WheelTimer
+    {
+        uint32_t expiresMs = 0;
+        int16_t prev = -1;
+        int16_t next = -1;
+        int8_t level = -1; // -1 = not armed
+        uint8_t slot = 0;
+    };
+    WheelTimer timers_[kTimerCount];
+    int16_t wheel_[kWheelLevels][kWheelSlots];
+    uint64_t wheelOcc_[kWheelLevels] = {}; // bit n = slot n non-empty
+    uint32_t wheelNextTick_ = 0;            // next tick whose level-0 slot has not run
+
+    // Broadcast-lane frames (data broadcast, JOIN, JOIN ack) wait until the previous one's airtime plus
+    // DIFS, mean backoff and jitter has passed; unicast lanes keep sending meanwhile. Guarded by txLock_.
+    bool bcastPaced_ = false;
+    uint32_t bcastPaceUntilUs_ = 0;
+    AirBucket airGlobal_; // airtimeBudgetMsPerSec, guarded by txLock_
+
+    uint16_t groupCwndQ8_ = 256; // CongestionMode::Group window x256 (send task only)
+    uint32_t groupCwndCutMs_ = 0;
+
     static EspNowBus *instance_;
 
     bool pendingJoin_ = false;
@@ -264,22 +730,115 @@ private:
 
     void sendTaskLoop();
     void handleSendComplete(bool ok, bool timedOut);
-    bool sendNextIfIdle(TickType_t waitTicks);
-    bool startSend(const TxItem &item);
-    bool enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const void *data, size_t len, uint32_t timeoutMs);
+    bool sendNextIfIdle();
+    bool startSend(TxItem &item);
+    bool retransmit(int slot);
+    void serviceInFlight(uint32_t nowMs);
+    void finishInFlight(int slot, SendStatus status, bool success);
+    uint32_t nextWaitMs(uint32_t nowMs);
+    void timerReset(uint32_t nowMs);
+    void wheelInsert(size_t id);
+    void wheelUnlink(size_t id);
+    int16_t wheelDetach(size_t level, size_t slot);
+    bool wheelNextEvent(uint32_t &tick) const;
+    void armTimerLocked(size_t id, uint32_t expiresMs);
+    void armTimer(size_t id, uint32_t expiresMs);
+    void cancelTimer(size_t id);
+    size_t advanceTimers(uint32_t nowMs, uint8_t *fired);
+    bool nextTimerMs(uint32_t &dueMs);
+    void onTimer(size_t id, uint32_t nowMs);
+    void servicePeerLiveness(size_t idx, uint32_t nowMs);
+    uint32_t frameAirtimeUs(size_t len) const;
+    void refillAir(AirBucket &bucket, uint32_t rateMsPerSec, uint32_t nowUs);
+    void serviceAirtimeLocked(uint32_t nowUs);
+    bool airtimeBlocked(const TxLane &lane) const;
+    bool laneIdle(const TxLane &lane) const;
+    bool rejectIfOverBudget(const uint8_t mac[6], size_t len);
+    bool windowOpen(const uint8_t mac[6]) const;
+    static constexpr int kFragRejected = -2; // fragmentSlot(): no pool or over maxMessageBytes, retrying cannot help
+    int fragmentSlot(const uint8_t mac[6], const uint8_t *payload, int len);
+    void storeFragment(int slot, const uint8_t *payload, int len, bool isRetry);
+    uint16_t bulkChunkSize() const;
+    void serviceBulk(uint32_t nowMs);
+    bool sendBulkChunk(const BulkTx &tx, uint32_t index, bool poll);
+    void finishBulk(BulkEvent event);
+    void processBulkAck(const uint8_t mac[6], const BulkAckPayload &ack);
+    void receiveBulk(const uint8_t mac[6], const uint8_t *payload, int len);
+    void sendBulkAck(const uint8_t mac[6], uint32_t transferId, uint8_t flags);
+    void recordBroadcast(TxItem &item, uint8_t *buf);
+    bool trackBroadcastGap(const uint8_t mac[6], uint16_t dataSeq);
+    void flushNack(size_t idx, uint32_t nowMs);
+    void processNack(const uint8_t mac[6], const NackPayload &nack);
+    void addFecMember(const TxItem &item, uint8_t *buf, uint16_t dataSeq);
+    void flushFecParity();
+    FecRx *fecBlock(const uint8_t mac[6], uint16_t first);
+    bool absorbFecData(const uint8_t mac[6], uint16_t dataSeq, uint8_t pos, const uint8_t *data, int len);
+    void absorbFecParity(const uint8_t mac[6], const uint8_t *payload, int len);
+    void rebuildFecFrame(FecRx &b);
+    void congestionOnAck(const uint8_t mac[6]);
+    void congestionOnLoss(const uint8_t mac[6]);
+    void paceBroadcast(const TxItem &item);
+    int allocInFlight();
+    bool pushTx(const TxItem &item);
+    bool replaceQueued(TxItem &item, TxItem &stale);
+    bool popTx(TxItem &out);
+    bool popTxClass(size_t cls, TxItem &out);
+    void unlinkTxNode(size_t li, size_t cls, int16_t prev, TxItem &out);
+    bool popExpiredTx(uint32_t nowMs, TxItem &out);
+    bool popPeerDataTx(const uint8_t mac[6], TxItem &out);
+    bool rejectIfCircuitOpen(const uint8_t mac[6]);
+    void serviceCircuit(size_t idx, uint32_t nowMs);
+    void dropExpiredTx(uint32_t nowMs);
+    static bool isExpired(const TxItem &item, uint32_t nowMs);
+    bool popTxFollower(const TxItem &lead, size_t room, uint16_t firstMsgId, TxItem &out);
+    void coalesceUnicast(TxItem &lead);
+    void reportSendResult(const TxItem &item, SendStatus status);
+    int findLane(const uint8_t mac[6]) const;
+    bool laneEligible(const TxLane &lane, size_t cls) const;
+    uint16_t perPeerQueueCap() const;
+    uint8_t inFlightCount(const uint8_t mac[6]) const;
+    // an ack covers frames up to 32 behind its msgId, each container's records up to 31 before its header
+    static constexpr size_t kMaxAckedIds = 2 * kReplayWindow;
+    uint8_t markAppAcked(const uint8_t mac[6], const AppAckPayload &ack, uint16_t *ackedIds);
+    void wakeSendTask();
+    void updateRtt(PeerInfo &peer, uint32_t sampleMs);
+    uint32_t peerRtoMs(const uint8_t mac[6]) const;
+    void backoffRto(const uint8_t mac[6]);
+    uint32_t retryBackoffMs(uint8_t attempt) const;
+    void queueAppAck(int peerIdx, const uint8_t mac[6], uint16_t msgId);
+    void buildAppAck(const PeerInfo &peer, AppAckPayload &ack) const;
+    bool takePendingAck(const uint8_t mac[6], AppAckPayload &ack);
+    void flushAppAck(size_t idx, uint32_t nowMs);
+    void processAppAck(const uint8_t mac[6], int peerIdx, const AppAckPayload &ack, bool cumulative);
+    bool enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const void *data, size_t len, uint32_t timeoutMs, Priority priority);
+    bool enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const void *data, size_t len, const SendOptions &opts);
+    bool enqueueCommon(Dest dest, PacketType pktType, const uint8_t *mac, const SendSegment *segments, size_t count, const SendOptions &opts);
+    static size_t segmentsLength(const SendSegment *segments, size_t count);
+    static bool packetNeedsAuth(uint8_t pktType);
+    size_t frameHeaderLen(PacketType pktType) const;
+    size_t fecReserve(PacketType pktType) const;
+    uint16_t frameLimit() const;
+    uint16_t allocMsgId();
+    int16_t acquireBuffer(PacketType pktType, const uint8_t *mac, size_t len, uint32_t timeoutMs, SendStatus *failed = nullptr);
+    bool finalizeAndQueue(Dest dest, PacketType pktType, const uint8_t *mac, uint16_t bufIdx, size_t len, const SendOptions &opts);
+    bool queueTxItem(TxItem &item);
     int findPeerIndex(const uint8_t mac[6]) const;
     int findSenderIndex(const uint8_t mac[6]) const;
     int ensureSender(const uint8_t mac[6]);
+    void forgetSender(const uint8_t mac[6]);
     int ensurePeer(const uint8_t mac[6]);
     uint8_t *bufferPtr(uint16_t idx);
-    int16_t allocBuffer();
+    int bufferClassOf(uint16_t idx) const;
+    uint16_t bufferCapacity(uint16_t idx) const;
+    int16_t allocBuffer(size_t cls);
     void freeBuffer(uint16_t idx);
     bool deriveKeys(const char *groupName);
     void computeAuthTag(uint8_t *out, const uint8_t *msg, size_t len, const uint8_t *key);
     bool verifyAuthTag(const uint8_t *msg, size_t len, uint8_t pktType);
     bool acceptBroadcastSeq(const uint8_t mac[6], uint16_t seq);
+    bool acceptUnicastMsgId(PeerInfo &peer, uint16_t msgId);
     void reseedCounters(uint32_t now);
-    bool acceptAppAck(PeerInfo &peer, uint16_t msgId);
+    bool acceptAppAck(PeerInfo &peer, uint16_t msgId, bool cumulative);
     void sendLeaveOnce();
 
     // failure tracking
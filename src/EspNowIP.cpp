@@ -312,10 +312,6 @@ bool EspNowIP::sendIpDataToActive(const void *data, size_t len)
     if (total > config_.maxPayloadBytes)
         return false;
 
-    uint8_t *buffer = static_cast<uint8_t *>(malloc(total));
-    if (!buffer)
-        return false;
-
     AppHeader app{};
     app.protocolId = kProtocolIdIp;
     app.protocolVer = kProtocolVersion;
@@ -325,11 +321,12 @@ bool EspNowIP::sendIpDataToActive(const void *data, size_t len)
           sessions_[activeSession_].mac[0], sessions_[activeSession_].mac[1], sessions_[activeSession_].mac[2],
           sessions_[activeSession_].mac[3], sessions_[activeSession_].mac[4], sessions_[activeSession_].mac[5],
           static_cast<unsigned>(len), frameType(data, len));
-    memcpy(buffer, &app, sizeof(app));
-    memcpy(buffer + sizeof(app), data, len);
-    bool ok = bus_.sendTo(sessions_[activeSession_].mac, buffer, total, EspNowBus::kUseDefault);
-    free(buffer);
-    return ok;
+    // header and IP frame are gathered straight into the bus frame
+    const EspNowBus::SendSegment segments[] = {
+        {&app, sizeof(app)},
+        {data, len},
+    };
+    return bus_.sendTo(sessions_[activeSession_].mac, segments, 2, EspNowBus::kUseDefault);
 }
 
 void EspNowIP::receiveIpData(const uint8_t *mac, const uint8_t *payload, size_t len)
@@ -847,8 +844,9 @@ bool EspNowIPGateway::sendFrameToMac(const uint8_t mac[6], const void *data, siz
     if (total > config_.maxPayloadBytes)
         return false;
 
-    uint8_t *buffer = static_cast<uint8_t *>(malloc(total));
-    if (!buffer)
+    // Serialize straight into the bus frame buffer (broadcast MAC selects a broadcast frame)
+    EspNowBus::SendReservation res;
+    if (!bus_.reserve(mac, total, res, EspNowBus::kUseDefault))
         return false;
 
     EspNowIP::AppHeader app{};
@@ -856,17 +854,9 @@ bool EspNowIPGateway::sendFrameToMac(const uint8_t mac[6], const void *data, siz
     app.protocolVer = EspNowIP::kProtocolVersion;
     app.packetType = EspNowIP::IpData;
     app.flags = 0;
-    memcpy(buffer, &app, sizeof(app));
-    memcpy(buffer + sizeof(app), data, len);
-
-    bool ok = false;
-    static const uint8_t kBroadcastMac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-    if (memcmp(mac, kBroadcastMac, 6) == 0)
-        ok = bus_.broadcast(buffer, total, EspNowBus::kUseDefault);
-    else
-        ok = bus_.sendTo(mac, buffer, total, EspNowBus::kUseDefault);
-    free(buffer);
-    return ok;
+    memcpy(res.data, &app, sizeof(app));
+    memcpy(res.data + sizeof(app), data, len);
+    return bus_.commit(res, total);
 }
 
 esp_err_t EspNowIPGateway::netifPostAttach(esp_netif_t *netif, esp_netif_iodriver_handle h)
@@ -634,26 +634,24 @@ bool EspNowSerial::sendChunk(Session &session, const uint8_t *payload, size_t le
     if (!payload || len == 0)
         return false;
 
-    const size_t totalLen = sizeof(AppHeader) + sizeof(SerialDataHeader) + len;
-    uint8_t *buf = static_cast<uint8_t *>(malloc(totalLen));
-    if (!buf)
-        return false;
-
-    auto *app = reinterpret_cast<AppHeader *>(buf);
-    app->protocolId = kProtocolIdSerial;
-    app->protocolVer = kProtocolVersion;
-    app->packetType = SerialData;
-    app->flags = 0;
-
-    auto *hdr = reinterpret_cast<SerialDataHeader *>(buf + sizeof(AppHeader));
-    hdr->endpointId = config_.endpointId;
-    hdr->reserved = 0;
-    hdr->sessionNonce = session.sessionNonce;
-
-    memcpy(buf + sizeof(AppHeader) + sizeof(SerialDataHeader), payload, len);
-    bool ok = bus_.sendTo(session.mac, buf, totalLen);
-    free(buf);
-    return ok;
+    AppHeader app{};
+    app.protocolId = kProtocolIdSerial;
+    app.protocolVer = kProtocolVersion;
+    app.packetType = SerialData;
+    app.flags = 0;
+
+    SerialDataHeader hdr{};
+    hdr.endpointId = config_.endpointId;
+    hdr.reserved = 0;
+    hdr.sessionNonce = session.sessionNonce;
+
+    // headers and payload are gathered straight into the bus frame
+    const EspNowBus::SendSegment segments[] = {
+        {&app, sizeof(app)},
+        {&hdr, sizeof(hdr)},
+        {payload, len},
+    };
+    return bus_.sendTo(session.mac, segments, 3);
 }
 
 void EspNowSerial::pollIfNeeded()